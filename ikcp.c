@@ -16,6 +16,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <sys/uio.h>
 
 
 
@@ -30,6 +31,7 @@ const IUINT32 IKCP_CMD_PUSH = 81;		// cmd: push data
 const IUINT32 IKCP_CMD_ACK  = 82;		// cmd: ack
 const IUINT32 IKCP_CMD_WASK = 83;		// cmd: window probe (ask)
 const IUINT32 IKCP_CMD_WINS = 84;		// cmd: window size (tell)
+const IUINT32 IKCP_CMD_SACK = 85;		// cmd: ack sn ranges, payload is (start, end) pairs
 const IUINT32 IKCP_ASK_SEND = 1;		// need to send IKCP_CMD_WASK
 const IUINT32 IKCP_ASK_TELL = 2;		// need to send IKCP_CMD_WINS
 const IUINT32 IKCP_WND_SND = 32;
@@ -44,6 +46,13 @@ const IUINT32 IKCP_THRESH_MIN = 2;
 const IUINT32 IKCP_PROBE_INIT = 7000;		// 7 secs to probe window size
 const IUINT32 IKCP_PROBE_LIMIT = 120000;	// up to 120 secs to probe window
 const IUINT32 IKCP_FASTACK_LIMIT = 5;		// max times to trigger fastack
+const IUINT32 IKCP_SACK_HELLO = 1;		// frg of control segments: sack supported
+const IUINT32 IKCP_SACK_ECHO = 2;		// frg of control segments: peer's hello heard
+const IUINT32 IKCP_SACK_ON = 1;			// kcp->sack: enabled locally
+const IUINT32 IKCP_SACK_PEER = 2;		// kcp->sack: peer sent hello, ranges may be sent
+const IUINT32 IKCP_SACK_HEARD = 4;		// kcp->sack: peer echoed, stop sending hello
+const IUINT32 IKCP_SACK_TRIES = 8;		// hello probes before giving up on old peers
+const IUINT32 IKCP_ACK_DELAY = 40;		// default max ms a delayed ack is held
 
 
 //---------------------------------------------------------------------
@@ -228,6 +237,161 @@ void ikcp_qprint(const char *name, const struct IQUEUEHEAD *head)
 }
 
 
+//---------------------------------------------------------------------
+// rcv_buf ring: a power of two no smaller than rcv_wnd, so every sn in
+// [rcv_nxt, rcv_nxt + rcv_wnd) owns a slot. it only grows: segments kept
+// from a larger window stay addressable after the window shrinks
+//---------------------------------------------------------------------
+static int ikcp_rcv_resize(ikcpcb *kcp, IUINT32 wnd)
+{
+	IKCPSEG **ring;
+	IUINT32 size, i;
+
+	if (kcp->rcv_buf != NULL && wnd <= kcp->rcv_mask + 1) return 0;
+
+	for (size = 1; size < wnd; size <<= 1);
+	ring = (IKCPSEG**)ikcp_malloc(size * sizeof(IKCPSEG*));
+	if (ring == NULL) return -1;
+	memset(ring, 0, size * sizeof(IKCPSEG*));
+
+	if (kcp->rcv_buf != NULL) {
+		for (i = 0; i <= kcp->rcv_mask; i++) {
+			IKCPSEG *seg = kcp->rcv_buf[i];
+			if (seg) ring[seg->sn & (size - 1)] = seg;
+		}
+		ikcp_free(kcp->rcv_buf);
+	}
+
+	kcp->rcv_buf = ring;
+	kcp->rcv_mask = size - 1;
+	return 0;
+}
+
+// snd_ring: the same scheme for segments in flight, sized by snd_wnd.
+// snd_nxt - snd_una never exceeds the window in use, so sn owns a slot.
+// the rto heap and the fast retransmit list hold at most one entry per
+// segment in flight and share its capacity
+static int ikcp_snd_resize(ikcpcb *kcp, IUINT32 wnd)
+{
+	IKCPSEG **ring, **heap;
+	IUINT32 *fastlist;
+	IUINT32 size, i;
+
+	if (kcp->snd_ring != NULL && wnd <= kcp->snd_mask + 1) return 0;
+
+	for (size = 1; size < wnd; size <<= 1);
+	ring = (IKCPSEG**)ikcp_malloc(size * sizeof(IKCPSEG*));
+	heap = (IKCPSEG**)ikcp_malloc(size * sizeof(IKCPSEG*));
+	fastlist = (IUINT32*)ikcp_malloc(size * sizeof(IUINT32));
+	if (ring == NULL || heap == NULL || fastlist == NULL) {
+		if (ring) ikcp_free(ring);
+		if (heap) ikcp_free(heap);
+		if (fastlist) ikcp_free(fastlist);
+		return -1;
+	}
+	memset(ring, 0, size * sizeof(IKCPSEG*));
+
+	if (kcp->snd_ring != NULL) {
+		for (i = 0; i <= kcp->snd_mask; i++) {
+			IKCPSEG *seg = kcp->snd_ring[i];
+			if (seg) ring[seg->sn & (size - 1)] = seg;
+		}
+		memcpy(heap, kcp->rto_heap, kcp->nrto_heap * sizeof(IKCPSEG*));
+		memcpy(fastlist, kcp->fastlist, kcp->nfastlist * sizeof(IUINT32));
+		ikcp_free(kcp->snd_ring);
+		ikcp_free(kcp->rto_heap);
+		ikcp_free(kcp->fastlist);
+	}
+
+	kcp->snd_ring = ring;
+	kcp->snd_mask = size - 1;
+	kcp->rto_heap = heap;
+	kcp->fastlist = fastlist;
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// rto heap: segments in flight ordered by resendts, seg->heap is the
+// index of the segment, so a flush only touches what is due
+//---------------------------------------------------------------------
+static void ikcp_heap_set(ikcpcb *kcp, IUINT32 i, IKCPSEG *seg)
+{
+	kcp->rto_heap[i] = seg;
+	seg->heap = i;
+}
+
+static void ikcp_heap_up(ikcpcb *kcp, IUINT32 i)
+{
+	IKCPSEG *seg = kcp->rto_heap[i];
+	while (i > 0) {
+		IUINT32 parent = (i - 1) >> 1;
+		if (_itimediff(seg->resendts, kcp->rto_heap[parent]->resendts) >= 0) break;
+		ikcp_heap_set(kcp, i, kcp->rto_heap[parent]);
+		i = parent;
+	}
+	ikcp_heap_set(kcp, i, seg);
+}
+
+static void ikcp_heap_down(ikcpcb *kcp, IUINT32 i)
+{
+	IKCPSEG *seg = kcp->rto_heap[i];
+	IUINT32 n = kcp->nrto_heap;
+	while (1) {
+		IUINT32 child = i * 2 + 1;
+		if (child >= n) break;
+		if (child + 1 < n && _itimediff(kcp->rto_heap[child + 1]->resendts,
+			kcp->rto_heap[child]->resendts) < 0) {
+			child++;
+		}
+		if (_itimediff(kcp->rto_heap[child]->resendts, seg->resendts) >= 0) break;
+		ikcp_heap_set(kcp, i, kcp->rto_heap[child]);
+		i = child;
+	}
+	ikcp_heap_set(kcp, i, seg);
+}
+
+static void ikcp_heap_push(ikcpcb *kcp, IKCPSEG *seg)
+{
+	ikcp_heap_set(kcp, kcp->nrto_heap++, seg);
+	ikcp_heap_up(kcp, seg->heap);
+}
+
+// resendts of seg changed
+static void ikcp_heap_update(ikcpcb *kcp, IKCPSEG *seg)
+{
+	ikcp_heap_up(kcp, seg->heap);
+	ikcp_heap_down(kcp, seg->heap);
+}
+
+static void ikcp_heap_remove(ikcpcb *kcp, IKCPSEG *seg)
+{
+	IUINT32 i = seg->heap;
+	IKCPSEG *last;
+	if (i >= kcp->nrto_heap || kcp->rto_heap[i] != seg) return;
+	last = kcp->rto_heap[--kcp->nrto_heap];
+	if (last != seg) {
+		ikcp_heap_set(kcp, i, last);
+		ikcp_heap_update(kcp, last);
+	}
+}
+
+// move available data from rcv_buf -> rcv_queue
+static void ikcp_rcv_drain(ikcpcb *kcp)
+{
+	while (kcp->nrcv_buf > 0 && kcp->nrcv_que < kcp->rcv_wnd) {
+		IKCPSEG **slot = &kcp->rcv_buf[kcp->rcv_nxt & kcp->rcv_mask];
+		IKCPSEG *seg = *slot;
+		if (seg == NULL) break;
+		*slot = NULL;
+		kcp->nrcv_buf--;
+		iqueue_add_tail(&seg->node, &kcp->rcv_queue);
+		kcp->nrcv_que++;
+		kcp->rcv_nxt++;
+	}
+}
+
+
 //---------------------------------------------------------------------
 // create a new kcpcb
 //---------------------------------------------------------------------
@@ -263,7 +427,25 @@ ikcpcb* ikcp_create(IUINT32 conv, void *user)
 	iqueue_init(&kcp->snd_queue);
 	iqueue_init(&kcp->rcv_queue);
 	iqueue_init(&kcp->snd_buf);
-	iqueue_init(&kcp->rcv_buf);
+	kcp->snd_ring = NULL;
+	kcp->snd_mask = 0;
+	kcp->rto_heap = NULL;
+	kcp->nrto_heap = 0;
+	kcp->fastlist = NULL;
+	kcp->nfastlist = 0;
+	kcp->rcv_buf = NULL;
+	kcp->rcv_mask = 0;
+	if (ikcp_snd_resize(kcp, kcp->snd_wnd) != 0 || 
+		ikcp_rcv_resize(kcp, kcp->rcv_wnd) != 0) {
+		if (kcp->snd_ring) {
+			ikcp_free(kcp->snd_ring);
+			ikcp_free(kcp->rto_heap);
+			ikcp_free(kcp->fastlist);
+		}
+		ikcp_free(kcp->buffer);
+		ikcp_free(kcp);
+		return NULL;
+	}
 	kcp->nrcv_buf = 0;
 	kcp->nsnd_buf = 0;
 	kcp->nrcv_que = 0;
@@ -290,6 +472,17 @@ ikcpcb* ikcp_create(IUINT32 conv, void *user)
 	kcp->dead_link = IKCP_DEADLINK;
 	kcp->output = NULL;
 	kcp->writelog = NULL;
+	kcp->cc = &ikcp_cc_default;
+	kcp->cc_state = NULL;
+	kcp->pacing_credit = 0;
+	kcp->ts_pacing = 0;
+	kcp->sack = 0;
+	kcp->ts_sack = 0;
+	kcp->sack_hello = 0;
+	kcp->ack_every = 0;
+	kcp->ack_delay = IKCP_ACK_DELAY;
+	kcp->ts_ack = 0;
+	kcp->ack_now = 0;
 
 	return kcp;
 }
@@ -308,10 +501,23 @@ void ikcp_release(ikcpcb *kcp)
 			iqueue_del(&seg->node);
 			ikcp_segment_delete(kcp, seg);
 		}
-		while (!iqueue_is_empty(&kcp->rcv_buf)) {
-			seg = iqueue_entry(kcp->rcv_buf.next, IKCPSEG, node);
-			iqueue_del(&seg->node);
-			ikcp_segment_delete(kcp, seg);
+		if (kcp->snd_ring) {
+			ikcp_free(kcp->snd_ring);
+			ikcp_free(kcp->rto_heap);
+			ikcp_free(kcp->fastlist);
+			kcp->snd_ring = NULL;
+			kcp->rto_heap = NULL;
+			kcp->fastlist = NULL;
+		}
+		if (kcp->rcv_buf) {
+			IUINT32 i;
+			for (i = 0; i <= kcp->rcv_mask; i++) {
+				if (kcp->rcv_buf[i]) {
+					ikcp_segment_delete(kcp, kcp->rcv_buf[i]);
+				}
+			}
+			ikcp_free(kcp->rcv_buf);
+			kcp->rcv_buf = NULL;
 		}
 		while (!iqueue_is_empty(&kcp->snd_queue)) {
 			seg = iqueue_entry(kcp->snd_queue.next, IKCPSEG, node);
@@ -323,6 +529,9 @@ void ikcp_release(ikcpcb *kcp)
 			iqueue_del(&seg->node);
 			ikcp_segment_delete(kcp, seg);
 		}
+		if (kcp->cc->release) {
+			kcp->cc->release(kcp);
+		}
 		if (kcp->buffer) {
 			ikcp_free(kcp->buffer);
 		}
@@ -352,6 +561,23 @@ void ikcp_setoutput(ikcpcb *kcp, int (*output)(const char *buf, int len,
 }
 
 
+//---------------------------------------------------------------------
+// move available data from rcv_buf -> rcv_queue after the user took
+// a message from rcv_queue
+//---------------------------------------------------------------------
+static void ikcp_rcv_refill(ikcpcb *kcp, int recover)
+{
+	ikcp_rcv_drain(kcp);
+
+	// fast recover
+	if (kcp->nrcv_que < kcp->rcv_wnd && recover) {
+		// ready to send back IKCP_CMD_WINS in ikcp_flush
+		// tell remote my window size
+		kcp->probe |= IKCP_ASK_TELL;
+	}
+}
+
+
 //---------------------------------------------------------------------
 // user/upper level recv: returns size, returns below zero for EAGAIN
 //---------------------------------------------------------------------
@@ -410,30 +636,63 @@ int ikcp_recv(ikcpcb *kcp, char *buffer, int len)
 
 	assert(len == peeksize);
 
-	// move available data from rcv_buf -> rcv_queue
-	while (! iqueue_is_empty(&kcp->rcv_buf)) {
-		seg = iqueue_entry(kcp->rcv_buf.next, IKCPSEG, node);
-		if (seg->sn == kcp->rcv_nxt && kcp->nrcv_que < kcp->rcv_wnd) {
-			iqueue_del(&seg->node);
-			kcp->nrcv_buf--;
-			iqueue_add_tail(&seg->node, &kcp->rcv_queue);
-			kcp->nrcv_que++;
-			kcp->rcv_nxt++;
-		}	else {
-			break;
+	ikcp_rcv_refill(kcp, recover);
+
+	return len;
+}
+
+
+//---------------------------------------------------------------------
+// user/upper level recv without copy
+//---------------------------------------------------------------------
+int ikcp_recv_detach(ikcpcb *kcp, struct IQUEUEHEAD *queue)
+{
+	struct IQUEUEHEAD *p;
+	int recover = 0;
+	int len = 0;
+	IKCPSEG *seg;
+	assert(kcp);
+	assert(queue);
+
+	if (iqueue_is_empty(&kcp->rcv_queue))
+		return -1;
+
+	if (ikcp_peeksize(kcp) < 0)
+		return -2;
+
+	if (kcp->nrcv_que >= kcp->rcv_wnd)
+		recover = 1;
+
+	for (p = kcp->rcv_queue.next; p != &kcp->rcv_queue; ) {
+		int fragment;
+		seg = iqueue_entry(p, IKCPSEG, node);
+		p = p->next;
+
+		len += seg->len;
+		fragment = seg->frg;
+
+		if (ikcp_canlog(kcp, IKCP_LOG_RECV)) {
+			ikcp_log(kcp, IKCP_LOG_RECV, "recv sn=%lu", (unsigned long)seg->sn);
 		}
-	}
 
-	// fast recover
-	if (kcp->nrcv_que < kcp->rcv_wnd && recover) {
-		// ready to send back IKCP_CMD_WINS in ikcp_flush
-		// tell remote my window size
-		kcp->probe |= IKCP_ASK_TELL;
+		iqueue_del(&seg->node);
+		iqueue_add_tail(&seg->node, queue);
+		kcp->nrcv_que--;
+
+		if (fragment == 0) 
+			break;
 	}
 
+	ikcp_rcv_refill(kcp, recover);
+
 	return len;
 }
 
+void ikcp_segment_release(struct IKCPSEG *seg)
+{
+	ikcp_free(seg);
+}
+
 
 //---------------------------------------------------------------------
 // peek data size
@@ -537,6 +796,83 @@ int ikcp_send(ikcpcb *kcp, const char *buffer, int len)
 }
 
 
+//---------------------------------------------------------------------
+// build segments from a gather list, payload is copied once
+//---------------------------------------------------------------------
+int ikcp_segments_build(ikcpcb *kcp, const struct iovec *iov, int iovcnt,
+	struct IQUEUEHEAD *queue)
+{
+	struct IQUEUEHEAD built;
+	const char *src = NULL;
+	size_t left = 0;
+	long len = 0;
+	int count, i, k = 0;
+	IKCPSEG *seg;
+
+	assert(kcp->mss > 0);
+	if (iovcnt < 0) return -1;
+
+	for (i = 0; i < iovcnt; i++) {
+		len += (long)iov[i].iov_len;
+	}
+
+	if (len <= (long)kcp->mss) count = 1;
+	else count = (int)((len + kcp->mss - 1) / kcp->mss);
+
+	if (count >= (int)IKCP_WND_RCV) return -2;
+
+	iqueue_init(&built);
+	for (i = 0; i < count; i++) {
+		int size = len > (long)kcp->mss ? (int)kcp->mss : (int)len;
+		int offset = 0;
+		seg = ikcp_segment_new(kcp, size);
+		if (seg == NULL) {
+			while (!iqueue_is_empty(&built)) {
+				seg = iqueue_entry(built.next, IKCPSEG, node);
+				iqueue_del(&seg->node);
+				ikcp_segment_delete(kcp, seg);
+			}
+			return -2;
+		}
+		while (offset < size) {
+			int n;
+			if (left == 0) {
+				src = (const char*)iov[k].iov_base;
+				left = iov[k].iov_len;
+				k++;
+				continue;
+			}
+			n = (left < (size_t)(size - offset))? (int)left : (size - offset);
+			memcpy(seg->data + offset, src, n);
+			offset += n;
+			src += n;
+			left -= n;
+		}
+		seg->len = size;
+		seg->frg = (kcp->stream == 0)? (count - i - 1) : 0;
+		iqueue_add_tail(&seg->node, &built);
+		len -= size;
+	}
+
+	// append to the tail of queue
+	iqueue_splice(&built, queue->prev);
+	return count;
+}
+
+int ikcp_send_segments(ikcpcb *kcp, struct IQUEUEHEAD *queue)
+{
+	int count = 0;
+	while (!iqueue_is_empty(queue)) {
+		IKCPSEG *seg = iqueue_entry(queue->next, IKCPSEG, node);
+		iqueue_del(&seg->node);
+		iqueue_add_tail(&seg->node, &kcp->snd_queue);
+		kcp->nsnd_que++;
+		count++;
+	}
+	return count;
+}
+
+
 //---------------------------------------------------------------------
 // parse ack
 //---------------------------------------------------------------------
@@ -568,35 +904,42 @@ static void ikcp_shrink_buf(ikcpcb *kcp)
 	}
 }
 
-static void ikcp_parse_ack(ikcpcb *kcp, IUINT32 sn)
+// returns bytes (with header) acknowledged, 0 if sn is not in snd_buf
+static IUINT32 ikcp_parse_ack(ikcpcb *kcp, IUINT32 sn)
 {
-	struct IQUEUEHEAD *p, *next;
+	IKCPSEG **slot, *seg;
+	IUINT32 bytes;
 
 	if (_itimediff(sn, kcp->snd_una) < 0 || _itimediff(sn, kcp->snd_nxt) >= 0)
-		return;
-
-	for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = next) {
-		IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
-		next = p->next;
-		if (sn == seg->sn) {
-			iqueue_del(p);
-			ikcp_segment_delete(kcp, seg);
-			kcp->nsnd_buf--;
-			break;
-		}
-		if (_itimediff(sn, seg->sn) < 0) {
-			break;
-		}
-	}
+		return 0;
+
+	slot = &kcp->snd_ring[sn & kcp->snd_mask];
+	seg = *slot;
+	if (seg == NULL || seg->sn != sn) 
+		return 0;
+
+	bytes = IKCP_OVERHEAD + seg->len;
+	*slot = NULL;
+	ikcp_heap_remove(kcp, seg);
+	iqueue_del(&seg->node);
+	ikcp_segment_delete(kcp, seg);
+	kcp->nsnd_buf--;
+	return bytes;
 }
 
-static void ikcp_parse_una(ikcpcb *kcp, IUINT32 una)
+// returns bytes (with header) acknowledged, 'segs' accumulates the count
+static IUINT32 ikcp_parse_una(ikcpcb *kcp, IUINT32 una, IUINT32 *segs)
 {
 	struct IQUEUEHEAD *p, *next;
+	IUINT32 bytes = 0;
 	for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = next) {
 		IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
 		next = p->next;
 		if (_itimediff(una, seg->sn) > 0) {
+			bytes += IKCP_OVERHEAD + seg->len;
+			segs[0]++;
+			kcp->snd_ring[seg->sn & kcp->snd_mask] = NULL;
+			ikcp_heap_remove(kcp, seg);
 			iqueue_del(p);
 			ikcp_segment_delete(kcp, seg);
 			kcp->nsnd_buf--;
@@ -604,11 +947,16 @@ static void ikcp_parse_una(ikcpcb *kcp, IUINT32 una)
 			break;
 		}
 	}
+	return bytes;
 }
 
+// acked segments have left snd_buf, so the walk only visits the holes
+// below sn. a hole reaching the resend threshold is queued on fastlist
+// and retransmitted by the next flush without scanning snd_buf
 static void ikcp_parse_fastack(ikcpcb *kcp, IUINT32 sn, IUINT32 ts)
 {
 	struct IQUEUEHEAD *p, *next;
+	IUINT32 resent = (kcp->fastresend > 0)? (IUINT32)kcp->fastresend : 0xffffffff;
 
 	if (_itimediff(sn, kcp->snd_una) < 0 || _itimediff(sn, kcp->snd_nxt) >= 0)
 		return;
@@ -616,18 +964,85 @@ static void ikcp_parse_fastack(ikcpcb *kcp, IUINT32 sn, IUINT32 ts)
 	for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = next) {
 		IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
 		next = p->next;
-		if (_itimediff(sn, seg->sn) < 0) {
+		if (_itimediff(sn, seg->sn) <= 0) {
 			break;
 		}
-		else if (sn != seg->sn) {
-		#ifndef IKCP_FASTACK_CONSERVE
+	#ifndef IKCP_FASTACK_CONSERVE
+		seg->fastack++;
+	#else
+		if (_itimediff(ts, seg->ts) >= 0)
 			seg->fastack++;
-		#else
-			if (_itimediff(ts, seg->ts) >= 0)
-				seg->fastack++;
-		#endif
+	#endif
+		if (seg->fastack == resent && kcp->nfastlist <= kcp->snd_mask) {
+			kcp->fastlist[kcp->nfastlist++] = seg->sn;
+		}
+	}
+}
+
+// decode the next range clipped to the unacked part of snd_buf, ranges
+// must ascend so an overlapping one is cut at the previous end 'low'
+static const char *ikcp_decode_range(ikcpcb *kcp, const char *data,
+	IUINT32 *low, IUINT32 *start, IUINT32 *end)
+{
+	data = ikcp_decode32u(data, start);
+	data = ikcp_decode32u(data, end);
+	if (_itimediff(*start, *low) < 0) *start = *low;
+	if (_itimediff(*end, kcp->snd_nxt) > 0) *end = kcp->snd_nxt;
+	if (_itimediff(*end, *start) > 0) *low = *end;
+	return data;
+}
+
+// segments inside the ranges are released, a hole gains one fastack
+// per segment newly acked above it. the newly acked total is counted
+// in snd_ring first, so the walk over snd_buf knows the gain of each
+// hole when reaching it and stops past the last range. as in
+// ikcp_parse_fastack a hole is queued on fastlist only when crossing
+// the resend threshold. returns bytes acknowledged, 'segs' accumulates
+// the count
+static IUINT32 ikcp_parse_sack(ikcpcb *kcp, const char *data, IUINT32 count,
+	IUINT32 *segs)
+{
+	struct IQUEUEHEAD *p = kcp->snd_buf.next, *next;
+	IUINT32 resent = (kcp->fastresend > 0)? (IUINT32)kcp->fastresend : 0xffffffff;
+	IUINT32 bytes = 0, acked = 0, total = 0, low, start, end, sn, i;
+	const char *ranges = data;
+
+	for (i = 0, low = kcp->snd_una; i < count; i++) {
+		data = ikcp_decode_range(kcp, data, &low, &start, &end);
+		for (sn = start; _itimediff(sn, end) < 0; sn++) {
+			IKCPSEG *seg = kcp->snd_ring[sn & kcp->snd_mask];
+			if (seg != NULL && seg->sn == sn) total++;
+		}
+	}
+
+	for (i = 0, low = kcp->snd_una, data = ranges; i < count && total > acked; i++) {
+		data = ikcp_decode_range(kcp, data, &low, &start, &end);
+		if (_itimediff(end, start) <= 0) continue;
+		for (; p != &kcp->snd_buf; p = next) {
+			IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
+			next = p->next;
+			if (_itimediff(seg->sn, end) >= 0) break;
+			if (_itimediff(seg->sn, start) < 0) {
+				IUINT32 fastack = seg->fastack + (total - acked);
+				if (seg->fastack < resent && fastack >= resent &&
+					kcp->nfastlist <= kcp->snd_mask) {
+					kcp->fastlist[kcp->nfastlist++] = seg->sn;
+				}
+				seg->fastack = fastack;
+				continue;
+			}
+			bytes += IKCP_OVERHEAD + seg->len;
+			acked++;
+			kcp->snd_ring[seg->sn & kcp->snd_mask] = NULL;
+			ikcp_heap_remove(kcp, seg);
+			iqueue_del(p);
+			ikcp_segment_delete(kcp, seg);
+			kcp->nsnd_buf--;
 		}
 	}
+
+	segs[0] += acked;
+	return bytes;
 }
 
 
@@ -664,6 +1079,10 @@ static void ikcp_ack_push(ikcpcb *kcp, IUINT32 sn, IUINT32 ts)
 		kcp->ackblock = newblock;
 	}
 
+	if (kcp->ackcount == 0) {
+		kcp->ts_ack = kcp->current;
+	}
+
 	ptr = &kcp->acklist[kcp->ackcount * 2];
 	ptr[0] = sn;
 	ptr[1] = ts;
@@ -682,9 +1101,8 @@ static void ikcp_ack_get(const ikcpcb *kcp, int p, IUINT32 *sn, IUINT32 *ts)
 //---------------------------------------------------------------------
 void ikcp_parse_data(ikcpcb *kcp, IKCPSEG *newseg)
 {
-	struct IQUEUEHEAD *p, *prev;
 	IUINT32 sn = newseg->sn;
-	int repeat = 0;
+	IKCPSEG **slot;
 	
 	if (_itimediff(sn, kcp->rcv_nxt + kcp->rcv_wnd) >= 0 ||
 		_itimediff(sn, kcp->rcv_nxt) < 0) {
@@ -692,54 +1110,18 @@ void ikcp_parse_data(ikcpcb *kcp, IKCPSEG *newseg)
 		return;
 	}
 
-	for (p = kcp->rcv_buf.prev; p != &kcp->rcv_buf; p = prev) {
-		IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
-		prev = p->prev;
-		if (seg->sn == sn) {
-			repeat = 1;
-			break;
-		}
-		if (_itimediff(sn, seg->sn) > 0) {
-			break;
-		}
-	}
-
-	if (repeat == 0) {
+	// the window check above keeps sn within the ring, a taken slot
+	// can only hold the same sn
+	slot = &kcp->rcv_buf[sn & kcp->rcv_mask];
+	if (*slot == NULL) {
 		iqueue_init(&newseg->node);
-		iqueue_add(&newseg->node, p);
+		*slot = newseg;
 		kcp->nrcv_buf++;
 	}	else {
 		ikcp_segment_delete(kcp, newseg);
 	}
 
-#if 0
-	ikcp_qprint("rcvbuf", &kcp->rcv_buf);
-	printf("rcv_nxt=%lu\n", kcp->rcv_nxt);
-#endif
-
-	// move available data from rcv_buf -> rcv_queue
-	while (! iqueue_is_empty(&kcp->rcv_buf)) {
-		IKCPSEG *seg = iqueue_entry(kcp->rcv_buf.next, IKCPSEG, node);
-		if (seg->sn == kcp->rcv_nxt && kcp->nrcv_que < kcp->rcv_wnd) {
-			iqueue_del(&seg->node);
-			kcp->nrcv_buf--;
-			iqueue_add_tail(&seg->node, &kcp->rcv_queue);
-			kcp->nrcv_que++;
-			kcp->rcv_nxt++;
-		}	else {
-			break;
-		}
-	}
-
-#if 0
-	ikcp_qprint("queue", &kcp->rcv_queue);
-	printf("rcv_nxt=%lu\n", kcp->rcv_nxt);
-#endif
-
-#if 1
-//	printf("snd(buf=%d, queue=%d)\n", kcp->nsnd_buf, kcp->nsnd_que);
-//	printf("rcv(buf=%d, queue=%d)\n", kcp->nrcv_buf, kcp->nrcv_que);
-#endif
+	ikcp_rcv_drain(kcp);
 }
 
 
@@ -750,6 +1132,8 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size)
 {
 	IUINT32 prev_una = kcp->snd_una;
 	IUINT32 maxack = 0, latest_ts = 0;
+	IUINT32 acked_segs = 0, acked_bytes = 0;
+	IINT32 rtt = -1;
 	int flag = 0;
 
 	if (ikcp_canlog(kcp, IKCP_LOG_INPUT)) {
@@ -782,18 +1166,31 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size)
 		if ((long)size < (long)len || (int)len < 0) return -2;
 
 		if (cmd != IKCP_CMD_PUSH && cmd != IKCP_CMD_ACK &&
-			cmd != IKCP_CMD_WASK && cmd != IKCP_CMD_WINS) 
+			cmd != IKCP_CMD_WASK && cmd != IKCP_CMD_WINS &&
+			cmd != IKCP_CMD_SACK) 
 			return -3;
 
+		// frg of control segments carries the sack announcement
+		if (cmd != IKCP_CMD_PUSH && (kcp->sack & IKCP_SACK_ON)) {
+			if (frg & IKCP_SACK_HELLO) kcp->sack |= IKCP_SACK_PEER;
+			if (frg & IKCP_SACK_ECHO) kcp->sack |= IKCP_SACK_HEARD;
+		}
+
 		kcp->rmt_wnd = wnd;
-		ikcp_parse_una(kcp, una);
+		acked_bytes += ikcp_parse_una(kcp, una, &acked_segs);
 		ikcp_shrink_buf(kcp);
 
 		if (cmd == IKCP_CMD_ACK) {
+			IUINT32 bytes;
 			if (_itimediff(kcp->current, ts) >= 0) {
-				ikcp_update_ack(kcp, _itimediff(kcp->current, ts));
+				rtt = _itimediff(kcp->current, ts);
+				ikcp_update_ack(kcp, rtt);
+			}
+			bytes = ikcp_parse_ack(kcp, sn);
+			if (bytes > 0) {
+				acked_segs++;
+				acked_bytes += bytes;
 			}
-			ikcp_parse_ack(kcp, sn);
 			ikcp_shrink_buf(kcp);
 			if (flag == 0) {
 				flag = 1;
@@ -826,6 +1223,10 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size)
 			}
 			if (_itimediff(sn, kcp->rcv_nxt + kcp->rcv_wnd) < 0) {
 				ikcp_ack_push(kcp, sn, ts);
+				// reordering, duplicates and filling a hole are not delayed
+				if (sn != kcp->rcv_nxt || kcp->nrcv_buf > 0) {
+					kcp->ack_now = 1;
+				}
 				if (_itimediff(sn, kcp->rcv_nxt) >= 0) {
 					seg = ikcp_segment_new(kcp, len);
 					seg->conv = conv;
@@ -845,6 +1246,21 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size)
 				}
 			}
 		}
+		else if (cmd == IKCP_CMD_SACK) {
+			if (len % 8 != 0) return -3;
+			if (_itimediff(kcp->current, ts) >= 0) {
+				rtt = _itimediff(kcp->current, ts);
+				ikcp_update_ack(kcp, rtt);
+			}
+			acked_bytes += ikcp_parse_sack(kcp, data, len / 8, &acked_segs);
+			ikcp_shrink_buf(kcp);
+			if (ikcp_canlog(kcp, IKCP_LOG_IN_ACK)) {
+				ikcp_log(kcp, IKCP_LOG_IN_ACK, 
+					"input sack: ranges=%lu rtt=%ld rto=%ld", 
+					(unsigned long)(len / 8),
+					(long)_itimediff(kcp->current, ts), (long)kcp->rx_rto);
+			}
+		}
 		else if (cmd == IKCP_CMD_WASK) {
 			// ready to send back IKCP_CMD_WINS in ikcp_flush
 			// tell remote my window size
@@ -872,28 +1288,8 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size)
 		ikcp_parse_fastack(kcp, maxack, latest_ts);
 	}
 
-	if (_itimediff(kcp->snd_una, prev_una) > 0) {
-		if (kcp->cwnd < kcp->rmt_wnd) {
-			IUINT32 mss = kcp->mss;
-			if (kcp->cwnd < kcp->ssthresh) {
-				kcp->cwnd++;
-				kcp->incr += mss;
-			}	else {
-				if (kcp->incr < mss) kcp->incr = mss;
-				kcp->incr += (mss * mss) / kcp->incr + (mss / 16);
-				if ((kcp->cwnd + 1) * mss <= kcp->incr) {
-				#if 1
-					kcp->cwnd = (kcp->incr + mss - 1) / ((mss > 0)? mss : 1);
-				#else
-					kcp->cwnd++;
-				#endif
-				}
-			}
-			if (kcp->cwnd > kcp->rmt_wnd) {
-				kcp->cwnd = kcp->rmt_wnd;
-				kcp->incr = kcp->rmt_wnd * mss;
-			}
-		}
+	if (kcp->cc->on_ack) {
+		kcp->cc->on_ack(kcp, prev_una, acked_segs, acked_bytes, rtt);
 	}
 
 	return 0;
@@ -925,6 +1321,104 @@ static int ikcp_wnd_unused(const ikcpcb *kcp)
 }
 
 
+// append a data segment to the output buffer, flushing it when full
+static char *ikcp_flush_segment(ikcpcb *kcp, IKCPSEG *segment, char *ptr,
+	IUINT32 wnd, IUINT32 pacing, IUINT32 *sent)
+{
+	char *buffer = kcp->buffer;
+	int size = (int)(ptr - buffer);
+	int need = IKCP_OVERHEAD + segment->len;
+
+	segment->ts = kcp->current;
+	segment->wnd = wnd;
+	segment->una = kcp->rcv_nxt;
+
+	sent[0] += need;
+	if (pacing > 0) kcp->pacing_credit -= need;
+
+	if (size + need > (int)kcp->mtu) {
+		ikcp_output(kcp, buffer, size);
+		ptr = buffer;
+	}
+
+	ptr = ikcp_encode_seg(ptr, segment);
+
+	if (segment->len > 0) {
+		memcpy(ptr, segment->data, segment->len);
+		ptr += segment->len;
+	}
+
+	if (segment->xmit >= kcp->dead_link) {
+		kcp->state = (IUINT32)-1;
+	}
+	return ptr;
+}
+
+// delayed ack: acknowledges wait for every'th segment or ack_delay ms,
+// and go out anyway with reordering or when data and probes are sent
+static int ikcp_ack_hold(const ikcpcb *kcp)
+{
+	if (kcp->ack_every <= 1 || kcp->ack_now) return 0;
+	if (kcp->ackcount >= kcp->ack_every) return 0;
+	if (_itimediff(kcp->current, kcp->ts_ack + kcp->ack_delay) >= 0) return 0;
+	if (kcp->probe != 0 || kcp->nsnd_que > 0 || kcp->nfastlist > 0) return 0;
+	if (kcp->nrto_heap > 0 && 
+		_itimediff(kcp->current, kcp->rto_heap[0]->resendts) >= 0) return 0;
+	return 1;
+}
+
+// one IKCP_CMD_SACK replaces the acklist: una covers the in order part,
+// the ranges describe rcv_buf, ts/sn echo the latest arrival for rtt
+static char *ikcp_flush_sack(ikcpcb *kcp, IKCPSEG *seg, char *ptr)
+{
+	char *buffer = kcp->buffer;
+	IUINT32 found = 0, count = 0, sn, start = 0, n, limit;
+	int inrange = 0;
+	int size = (int)(ptr - buffer);
+	char *head;
+
+	if (size + (int)IKCP_OVERHEAD * 2 > (int)kcp->mtu) {
+		ikcp_output(kcp, buffer, size);
+		ptr = buffer;
+	}
+
+	head = ptr;
+	ptr += IKCP_OVERHEAD;
+	size = (int)(ptr - buffer);
+
+	// rcv_nxt stays buffered while rcv_queue is full, so the scan starts
+	// there. it ends at the last of nrcv_buf segments and never passes the
+	// receive window, which keeps it inside the ring. ranges that do not
+	// fit are left to later sacks
+	limit = (kcp->rcv_wnd < kcp->rcv_mask + 1)? kcp->rcv_wnd : kcp->rcv_mask + 1;
+	for (sn = kcp->rcv_nxt, n = 0; n < limit && found < kcp->nrcv_buf; sn++, n++) {
+		IKCPSEG *rseg = kcp->rcv_buf[sn & kcp->rcv_mask];
+		int present = (rseg != NULL && rseg->sn == sn);
+		if (present) found++;
+		if (present && inrange == 0) {
+			start = sn;
+			inrange = 1;
+		}
+		if (inrange && (!present || found == kcp->nrcv_buf || n + 1 == limit)) {
+			if (size + 8 > (int)kcp->mtu) break;
+			ptr = ikcp_encode32u(ptr, start);
+			ptr = ikcp_encode32u(ptr, present? sn + 1 : sn);
+			size += 8;
+			count++;
+			inrange = 0;
+		}
+	}
+
+	ikcp_ack_get(kcp, kcp->ackcount - 1, &seg->sn, &seg->ts);
+	seg->cmd = IKCP_CMD_SACK;
+	seg->len = count * 8;
+	ikcp_encode_seg(head, seg);
+	seg->cmd = IKCP_CMD_ACK;
+	seg->len = 0;
+	return ptr;
+}
+
+
 //---------------------------------------------------------------------
 // ikcp_flush
 //---------------------------------------------------------------------
@@ -935,8 +1429,7 @@ void ikcp_flush(ikcpcb *kcp)
 	char *ptr = buffer;
 	int count, size, i;
 	IUINT32 resent, cwnd;
-	IUINT32 rtomin;
-	struct IQUEUEHEAD *p;
+	IUINT32 rtomin, pacing, sent = 0, n;
 	int change = 0;
 	int lost = 0;
 	IKCPSEG seg;
@@ -953,9 +1446,32 @@ void ikcp_flush(ikcpcb *kcp)
 	seg.sn = 0;
 	seg.ts = 0;
 
+	if (kcp->sack & IKCP_SACK_ON) {
+		seg.frg = IKCP_SACK_HELLO;
+		if (kcp->sack & IKCP_SACK_PEER) seg.frg |= IKCP_SACK_ECHO;
+		// a pure sender never acks, announce with a window tell
+		if ((kcp->sack & IKCP_SACK_HEARD) == 0 && kcp->nsnd_buf > 0 &&
+			kcp->sack_hello < IKCP_SACK_TRIES &&
+			_itimediff(current, kcp->ts_sack) >= 0) {
+			kcp->probe |= IKCP_ASK_TELL;
+			kcp->ts_sack = current + kcp->rx_rto;
+			kcp->sack_hello++;
+		}
+	}
+
 	// flush acknowledges
 	count = kcp->ackcount;
-	for (i = 0; i < count; i++) {
+	if (count > 0 && ikcp_ack_hold(kcp)) {
+		count = -1;
+	}
+	else if (count > 0 && (kcp->sack & IKCP_SACK_PEER)) {
+		ptr = ikcp_flush_sack(kcp, &seg, ptr);
+		count = 0;
+	}
+	// in order arrivals under the delayed policy are covered by una, the
+	// latest ack alone carries the ts for rtt
+	i = (count > 0 && kcp->ack_every > 1 && kcp->ack_now == 0)? count - 1 : 0;
+	for (; i < count; i++) {
 		size = (int)(ptr - buffer);
 		if (size + (int)IKCP_OVERHEAD > (int)kcp->mtu) {
 			ikcp_output(kcp, buffer, size);
@@ -965,7 +1481,10 @@ void ikcp_flush(ikcpcb *kcp)
 		ptr = ikcp_encode_seg(ptr, &seg);
 	}
 
-	kcp->ackcount = 0;
+	if (count >= 0) {
+		kcp->ackcount = 0;
+		kcp->ack_now = 0;
+	}
 
 	// probe window size (if remote window size equals zero)
 	if (kcp->rmt_wnd == 0) {
@@ -1015,12 +1534,74 @@ void ikcp_flush(ikcpcb *kcp)
 
 	// calculate window size
 	cwnd = _imin_(kcp->snd_wnd, kcp->rmt_wnd);
-	if (kcp->nocwnd == 0) cwnd = _imin_(kcp->cwnd, cwnd);
+	if (kcp->nocwnd == 0) cwnd = _imin_(kcp->cc->get_cwnd(kcp), cwnd);
+
+	// pacing: new data enters snd_buf no faster than the congestion control
+	// asks for, credit accumulates up to two flush intervals
+	pacing = ikcp_pacing_rate(kcp);
+	if (pacing > 0) {
+		IINT32 limit = (IINT32)_imax_((IUINT32)((IUINT64)pacing * kcp->interval * 2 / 1000), kcp->mtu * 4);
+		IINT32 elapsed = _itimediff(current, kcp->ts_pacing);
+		if (elapsed > 0) {
+			IINT64 credit = kcp->pacing_credit + (IINT64)pacing * elapsed / 1000;
+			kcp->pacing_credit = (IINT32)((credit > limit)? limit : credit);
+		}
+	}
+	kcp->ts_pacing = current;
+
+	// calculate resent
+	resent = (kcp->fastresend > 0)? (IUINT32)kcp->fastresend : 0xffffffff;
+	rtomin = (kcp->nodelay == 0)? (kcp->rx_rto >> 3) : 0;
+
+	// fast retransmits queued by ikcp_parse_fastack, a segment that has
+	// also timed out is left to the rto pass below
+	for (n = 0; n < kcp->nfastlist; n++) {
+		IUINT32 sn = kcp->fastlist[n];
+		IKCPSEG *segment;
+		if (_itimediff(sn, kcp->snd_una) < 0 || _itimediff(sn, kcp->snd_nxt) >= 0)
+			continue;
+		segment = kcp->snd_ring[sn & kcp->snd_mask];
+		if (segment == NULL || segment->sn != sn || segment->fastack < resent)
+			continue;
+		if (_itimediff(current, segment->resendts) >= 0)
+			continue;
+		if ((int)segment->xmit <= kcp->fastlimit || 
+			kcp->fastlimit <= 0) {
+			segment->xmit++;
+			segment->fastack = 0;
+			segment->resendts = current + segment->rto;
+			ikcp_heap_update(kcp, segment);
+			change++;
+			ptr = ikcp_flush_segment(kcp, segment, ptr, seg.wnd, pacing, &sent);
+		}
+	}
+	kcp->nfastlist = 0;
+
+	// timed out segments, popped from the rto heap until one is not due
+	for (n = kcp->nrto_heap; n > 0 && kcp->nrto_heap > 0; n--) {
+		IKCPSEG *segment = kcp->rto_heap[0];
+		if (_itimediff(current, segment->resendts) < 0) break;
+		segment->xmit++;
+		kcp->xmit++;
+		if (kcp->nodelay == 0) {
+			segment->rto += _imax_(segment->rto, (IUINT32)kcp->rx_rto);
+		}	else {
+			IINT32 step = (kcp->nodelay < 2)? 
+				((IINT32)(segment->rto)) : kcp->rx_rto;
+			segment->rto += step / 2;
+		}
+		segment->resendts = current + segment->rto;
+		segment->fastack = 0;
+		ikcp_heap_down(kcp, 0);
+		lost = 1;
+		ptr = ikcp_flush_segment(kcp, segment, ptr, seg.wnd, pacing, &sent);
+	}
 
-	// move data from snd_queue to snd_buf
+	// move data from snd_queue to snd_buf and send it
 	while (_itimediff(kcp->snd_nxt, kcp->snd_una + cwnd) < 0) {
 		IKCPSEG *newseg;
 		if (iqueue_is_empty(&kcp->snd_queue)) break;
+		if (pacing > 0 && kcp->pacing_credit <= 0) break;
 
 		newseg = iqueue_entry(kcp->snd_queue.next, IKCPSEG, node);
 
@@ -1028,83 +1609,17 @@ void ikcp_flush(ikcpcb *kcp)
 		iqueue_add_tail(&newseg->node, &kcp->snd_buf);
 		kcp->nsnd_que--;
 		kcp->nsnd_buf++;
+		kcp->snd_ring[kcp->snd_nxt & kcp->snd_mask] = newseg;
 
 		newseg->conv = kcp->conv;
 		newseg->cmd = IKCP_CMD_PUSH;
-		newseg->wnd = seg.wnd;
-		newseg->ts = current;
 		newseg->sn = kcp->snd_nxt++;
-		newseg->una = kcp->rcv_nxt;
-		newseg->resendts = current;
 		newseg->rto = kcp->rx_rto;
+		newseg->resendts = current + newseg->rto + rtomin;
 		newseg->fastack = 0;
-		newseg->xmit = 0;
-	}
-
-	// calculate resent
-	resent = (kcp->fastresend > 0)? (IUINT32)kcp->fastresend : 0xffffffff;
-	rtomin = (kcp->nodelay == 0)? (kcp->rx_rto >> 3) : 0;
-
-	// flush data segments
-	for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = p->next) {
-		IKCPSEG *segment = iqueue_entry(p, IKCPSEG, node);
-		int needsend = 0;
-		if (segment->xmit == 0) {
-			needsend = 1;
-			segment->xmit++;
-			segment->rto = kcp->rx_rto;
-			segment->resendts = current + segment->rto + rtomin;
-		}
-		else if (_itimediff(current, segment->resendts) >= 0) {
-			needsend = 1;
-			segment->xmit++;
-			kcp->xmit++;
-			if (kcp->nodelay == 0) {
-				segment->rto += _imax_(segment->rto, (IUINT32)kcp->rx_rto);
-			}	else {
-				IINT32 step = (kcp->nodelay < 2)? 
-					((IINT32)(segment->rto)) : kcp->rx_rto;
-				segment->rto += step / 2;
-			}
-			segment->resendts = current + segment->rto;
-			lost = 1;
-		}
-		else if (segment->fastack >= resent) {
-			if ((int)segment->xmit <= kcp->fastlimit || 
-				kcp->fastlimit <= 0) {
-				needsend = 1;
-				segment->xmit++;
-				segment->fastack = 0;
-				segment->resendts = current + segment->rto;
-				change++;
-			}
-		}
-
-		if (needsend) {
-			int need;
-			segment->ts = current;
-			segment->wnd = seg.wnd;
-			segment->una = kcp->rcv_nxt;
-
-			size = (int)(ptr - buffer);
-			need = IKCP_OVERHEAD + segment->len;
-
-			if (size + need > (int)kcp->mtu) {
-				ikcp_output(kcp, buffer, size);
-				ptr = buffer;
-			}
-
-			ptr = ikcp_encode_seg(ptr, segment);
-
-			if (segment->len > 0) {
-				memcpy(ptr, segment->data, segment->len);
-				ptr += segment->len;
-			}
-
-			if (segment->xmit >= kcp->dead_link) {
-				kcp->state = (IUINT32)-1;
-			}
-		}
+		newseg->xmit = 1;
+		ikcp_heap_push(kcp, newseg);
+		ptr = ikcp_flush_segment(kcp, newseg, ptr, seg.wnd, pacing, &sent);
 	}
 
 	// flash remain segments
@@ -1113,27 +1628,17 @@ void ikcp_flush(ikcpcb *kcp)
 		ikcp_output(kcp, buffer, size);
 	}
 
-	// update ssthresh
-	if (change) {
-		IUINT32 inflight = kcp->snd_nxt - kcp->snd_una;
-		kcp->ssthresh = inflight / 2;
-		if (kcp->ssthresh < IKCP_THRESH_MIN)
-			kcp->ssthresh = IKCP_THRESH_MIN;
-		kcp->cwnd = kcp->ssthresh + resent;
-		kcp->incr = kcp->cwnd * kcp->mss;
+	// update congestion control
+	if (change && kcp->cc->on_loss) {
+		kcp->cc->on_loss(kcp, IKCP_LOSS_FAST, change);
 	}
 
-	if (lost) {
-		kcp->ssthresh = cwnd / 2;
-		if (kcp->ssthresh < IKCP_THRESH_MIN)
-			kcp->ssthresh = IKCP_THRESH_MIN;
-		kcp->cwnd = 1;
-		kcp->incr = kcp->mss;
+	if (lost && kcp->cc->on_loss) {
+		kcp->cc->on_loss(kcp, IKCP_LOSS_TIMEOUT, cwnd);
 	}
 
-	if (kcp->cwnd < 1) {
-		kcp->cwnd = 1;
-		kcp->incr = kcp->mss;
+	if (kcp->cc->on_send) {
+		kcp->cc->on_send(kcp, sent);
 	}
 }
 
@@ -1186,7 +1691,6 @@ IUINT32 ikcp_check(const ikcpcb *kcp, IUINT32 current)
 	IINT32 tm_flush = 0x7fffffff;
 	IINT32 tm_packet = 0x7fffffff;
 	IUINT32 minimal = 0;
-	struct IQUEUEHEAD *p;
 
 	if (kcp->updated == 0) {
 		return current;
@@ -1203,13 +1707,12 @@ IUINT32 ikcp_check(const ikcpcb *kcp, IUINT32 current)
 
 	tm_flush = _itimediff(ts_flush, current);
 
-	for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = p->next) {
-		const IKCPSEG *seg = iqueue_entry(p, const IKCPSEG, node);
-		IINT32 diff = _itimediff(seg->resendts, current);
+	if (kcp->nrto_heap > 0) {
+		IINT32 diff = _itimediff(kcp->rto_heap[0]->resendts, current);
 		if (diff <= 0) {
 			return current;
 		}
-		if (diff < tm_packet) tm_packet = diff;
+		tm_packet = diff;
 	}
 
 	minimal = (IUINT32)(tm_packet < tm_flush ? tm_packet : tm_flush);
@@ -1273,10 +1776,13 @@ int ikcp_wndsize(ikcpcb *kcp, int sndwnd, int rcvwnd)
 {
 	if (kcp) {
 		if (sndwnd > 0) {
+			if (ikcp_snd_resize(kcp, sndwnd) != 0) return -2;
 			kcp->snd_wnd = sndwnd;
 		}
 		if (rcvwnd > 0) {   // must >= max fragment size
-			kcp->rcv_wnd = _imax_(rcvwnd, IKCP_WND_RCV);
+			IUINT32 wnd = _imax_(rcvwnd, IKCP_WND_RCV);
+			if (ikcp_rcv_resize(kcp, wnd) != 0) return -2;
+			kcp->rcv_wnd = wnd;
 		}
 	}
 	return 0;
@@ -1287,6 +1793,365 @@ int ikcp_waitsnd(const ikcpcb *kcp)
 	return kcp->nsnd_buf + kcp->nsnd_que;
 }
 
+int ikcp_idle(const ikcpcb *kcp)
+{
+	return kcp->nsnd_buf == 0 && kcp->nsnd_que == 0 && 
+		kcp->ackcount == 0 && kcp->probe == 0;
+}
+
+int ikcp_ackdelay(ikcpcb *kcp, int every, int delay)
+{
+	kcp->ack_every = (every > 1)? (IUINT32)every : 0;
+	kcp->ack_delay = (delay > 0)? (IUINT32)delay : IKCP_ACK_DELAY;
+	return 0;
+}
+
+int ikcp_setsack(ikcpcb *kcp, int enable)
+{
+	if (enable) {
+		kcp->sack |= IKCP_SACK_ON;
+	}	else {
+		kcp->sack = 0;
+		kcp->sack_hello = 0;
+	}
+	return 0;
+}
+
+
+//---------------------------------------------------------------------
+// congestion control
+//---------------------------------------------------------------------
+int ikcp_setcc(ikcpcb *kcp, const ikcpcc *cc)
+{
+	const ikcpcc *prev = kcp->cc;
+	void *state = kcp->cc_state;
+	if (cc == NULL || cc->get_cwnd == NULL) return -1;
+	kcp->cc_state = NULL;
+	if (cc->init && cc->init(kcp) < 0) {
+		kcp->cc_state = state;
+		return -2;
+	}
+	kcp->cc = cc;
+	if (prev->release) {
+		void *next = kcp->cc_state;
+		kcp->cc_state = state;
+		prev->release(kcp);
+		kcp->cc_state = next;
+	}
+	return 0;
+}
+
+IUINT32 ikcp_pacing_rate(const ikcpcb *kcp)
+{
+	if (kcp->nocwnd || kcp->cc->get_pacing_rate == NULL) return 0;
+	return kcp->cc->get_pacing_rate(kcp);
+}
+
+
+//---------------------------------------------------------------------
+// default: slow start / congestion avoidance on ack, window cut on loss
+//---------------------------------------------------------------------
+static void ikcp_cc_default_on_ack(ikcpcb *kcp, IUINT32 prev_una, 
+	IUINT32 segs, IUINT32 bytes, IINT32 rtt)
+{
+	if (_itimediff(kcp->snd_una, prev_una) > 0) {
+		if (kcp->cwnd < kcp->rmt_wnd) {
+			IUINT32 mss = kcp->mss;
+			if (kcp->cwnd < kcp->ssthresh) {
+				kcp->cwnd++;
+				kcp->incr += mss;
+			}	else {
+				if (kcp->incr < mss) kcp->incr = mss;
+				kcp->incr += (mss * mss) / kcp->incr + (mss / 16);
+				if ((kcp->cwnd + 1) * mss <= kcp->incr) {
+				#if 1
+					kcp->cwnd = (kcp->incr + mss - 1) / ((mss > 0)? mss : 1);
+				#else
+					kcp->cwnd++;
+				#endif
+				}
+			}
+			if (kcp->cwnd > kcp->rmt_wnd) {
+				kcp->cwnd = kcp->rmt_wnd;
+				kcp->incr = kcp->rmt_wnd * mss;
+			}
+		}
+	}
+}
+
+static void ikcp_cc_default_on_loss(ikcpcb *kcp, int kind, IUINT32 count)
+{
+	if (kind == IKCP_LOSS_FAST) {
+		IUINT32 inflight = kcp->snd_nxt - kcp->snd_una;
+		IUINT32 resent = (kcp->fastresend > 0)? (IUINT32)kcp->fastresend : 0xffffffff;
+		kcp->ssthresh = inflight / 2;
+		if (kcp->ssthresh < IKCP_THRESH_MIN)
+			kcp->ssthresh = IKCP_THRESH_MIN;
+		kcp->cwnd = kcp->ssthresh + resent;
+		kcp->incr = kcp->cwnd * kcp->mss;
+	}
+	else if (kind == IKCP_LOSS_TIMEOUT) {
+		kcp->ssthresh = count / 2;
+		if (kcp->ssthresh < IKCP_THRESH_MIN)
+			kcp->ssthresh = IKCP_THRESH_MIN;
+		kcp->cwnd = 1;
+		kcp->incr = kcp->mss;
+	}
+}
+
+static void ikcp_cc_default_on_send(ikcpcb *kcp, IUINT32 bytes)
+{
+	if (kcp->cwnd < 1) {
+		kcp->cwnd = 1;
+		kcp->incr = kcp->mss;
+	}
+}
+
+static IUINT32 ikcp_cc_default_get_cwnd(const ikcpcb *kcp)
+{
+	return kcp->cwnd;
+}
+
+const ikcpcc ikcp_cc_default = {
+	"default",
+	NULL,
+	NULL,
+	ikcp_cc_default_on_ack,
+	ikcp_cc_default_on_loss,
+	ikcp_cc_default_on_send,
+	ikcp_cc_default_get_cwnd,
+	NULL,
+};
+
+
+//---------------------------------------------------------------------
+// bbr: bottleneck bandwidth (max delivery rate over recent rounds) and
+// min rtt give the bdp, cwnd and pacing rate follow it with gains that
+// probe for more bandwidth and drain the queue. loss is not a signal.
+//---------------------------------------------------------------------
+#define IKCP_BBR_STARTUP		0
+#define IKCP_BBR_DRAIN			1
+#define IKCP_BBR_PROBE_BW		2
+#define IKCP_BBR_PROBE_RTT		3
+
+#define IKCP_BBR_BW_ROUNDS		10		// max filter length in rounds
+#define IKCP_BBR_RTT_WIN		10000	// min rtt expires after 10 secs
+#define IKCP_BBR_PROBE_RTT_TIME	200		// stay in probe rtt for 200ms
+#define IKCP_BBR_INIT_CWND		10
+#define IKCP_BBR_MIN_CWND		4
+#define IKCP_BBR_HIGH_GAIN		289		// 2/ln2 in percent
+#define IKCP_BBR_DRAIN_GAIN		35		// 1/high gain in percent
+#define IKCP_BBR_CWND_GAIN		200
+#define IKCP_BBR_FULL_ROUNDS	3		// rounds without 25% growth ends startup
+
+static const IUINT32 ikcp_bbr_cycle[8] = { 125, 75, 100, 100, 100, 100, 100, 100 };
+
+typedef struct IKCPBBR
+{
+	IUINT32 mode;
+	IUINT32 pacing_gain, cwnd_gain;		// percent
+	IUINT32 cwnd;						// segments
+	IUINT32 bw[IKCP_BBR_BW_ROUNDS];		// delivery rate per round, bytes/s
+	IUINT32 btl_bw;
+	IUINT32 min_rtt, min_rtt_ts, prev_min_rtt;
+	IUINT32 round, round_end, round_ts;
+	IUINT64 delivered, round_delivered;
+	IUINT32 full_bw, full_rounds, full_reached;
+	IUINT32 cycle, cycle_ts;
+	IUINT32 probe_rtt_ts;
+}	IKCPBBR;
+
+static int ikcp_cc_bbr_init(ikcpcb *kcp)
+{
+	IKCPBBR *bbr = (IKCPBBR*)ikcp_malloc(sizeof(IKCPBBR));
+	if (bbr == NULL) return -1;
+	memset(bbr, 0, sizeof(IKCPBBR));
+	bbr->mode = IKCP_BBR_STARTUP;
+	bbr->pacing_gain = IKCP_BBR_HIGH_GAIN;
+	bbr->cwnd_gain = IKCP_BBR_HIGH_GAIN;
+	bbr->cwnd = IKCP_BBR_INIT_CWND;
+	bbr->round_end = kcp->snd_nxt;
+	bbr->round_ts = kcp->current;
+	kcp->cc_state = bbr;
+	kcp->cwnd = bbr->cwnd;
+	return 0;
+}
+
+static void ikcp_cc_bbr_release(ikcpcb *kcp)
+{
+	if (kcp->cc_state) {
+		ikcp_free(kcp->cc_state);
+		kcp->cc_state = NULL;
+	}
+}
+
+// bandwidth delay product in segments, 0 before the first samples
+static IUINT32 ikcp_bbr_bdp(const ikcpcb *kcp, const IKCPBBR *bbr)
+{
+	IUINT64 bytes;
+	if (bbr->btl_bw == 0 || bbr->min_rtt == 0) return 0;
+	bytes = (IUINT64)bbr->btl_bw * bbr->min_rtt / 1000;
+	return (IUINT32)((bytes + kcp->mtu - 1) / kcp->mtu);
+}
+
+static void ikcp_bbr_enter_probe_bw(ikcpcb *kcp, IKCPBBR *bbr)
+{
+	bbr->mode = IKCP_BBR_PROBE_BW;
+	bbr->cycle = 2;
+	bbr->cycle_ts = kcp->current;
+	bbr->pacing_gain = ikcp_bbr_cycle[bbr->cycle];
+	bbr->cwnd_gain = IKCP_BBR_CWND_GAIN;
+}
+
+static void ikcp_cc_bbr_on_ack(ikcpcb *kcp, IUINT32 prev_una, 
+	IUINT32 segs, IUINT32 bytes, IINT32 rtt)
+{
+	IKCPBBR *bbr = (IKCPBBR*)kcp->cc_state;
+	IUINT32 current = kcp->current;
+	IUINT32 bdp, quantum, target, inflight, i;
+
+	bbr->delivered += bytes;
+
+	// min rtt, an expired one sends us to probe rtt to refresh it
+	if (rtt >= 0) {
+		if (rtt < 1) rtt = 1;
+		if (bbr->min_rtt == 0 || (IUINT32)rtt <= bbr->min_rtt) {
+			bbr->min_rtt = rtt;
+			bbr->min_rtt_ts = current;
+		}
+	}
+	if (bbr->mode != IKCP_BBR_PROBE_RTT && bbr->min_rtt > 0 &&
+		_itimediff(current, bbr->min_rtt_ts) > (IINT32)IKCP_BBR_RTT_WIN) {
+		bbr->mode = IKCP_BBR_PROBE_RTT;
+		bbr->pacing_gain = 100;
+		bbr->probe_rtt_ts = 0;
+	}
+
+	// a round lasts one min rtt. before the first sample it ends when the
+	// first segment sent after it started is acked; snd_una alone would
+	// stall behind a hole and freeze the model during loss recovery
+	if ((bbr->min_rtt > 0 && bbr->min_rtt != 0xffffffff)?
+		_itimediff(current, bbr->round_ts) >= (IINT32)bbr->min_rtt :
+		_itimediff(kcp->snd_una, bbr->round_end) > 0) {
+		IINT32 interval = _itimediff(current, bbr->round_ts);
+		// draining rounds are paced below the estimate on purpose
+		if (bbr->mode != IKCP_BBR_DRAIN) {
+			IUINT64 rate = 0;
+			if (interval > 0 && bbr->delivered > bbr->round_delivered) {
+				rate = (bbr->delivered - bbr->round_delivered) * 1000 / interval;
+			}
+			bbr->bw[bbr->round % IKCP_BBR_BW_ROUNDS] = (rate > 0xffffffff)? 0xffffffff : (IUINT32)rate;
+			bbr->btl_bw = 0;
+			for (i = 0; i < IKCP_BBR_BW_ROUNDS; i++) {
+				if (bbr->bw[i] > bbr->btl_bw) bbr->btl_bw = bbr->bw[i];
+			}
+			bbr->round++;
+		}
+		bbr->round_end = kcp->snd_nxt;
+		bbr->round_ts = current;
+		bbr->round_delivered = bbr->delivered;
+
+		if (bbr->full_reached == 0) {
+			if (bbr->btl_bw >= (IUINT64)bbr->full_bw * 5 / 4) {
+				bbr->full_bw = bbr->btl_bw;
+				bbr->full_rounds = 0;
+			}
+			else if (++bbr->full_rounds >= IKCP_BBR_FULL_ROUNDS) {
+				bbr->full_reached = 1;
+			}
+		}
+	}
+
+	// ikcp_flush hands everything the window allows to the output at once,
+	// so inflight always equals cwnd: outside startup the window follows the
+	// pacing gain, plus what the pacer releases during one flush interval
+	bdp = ikcp_bbr_bdp(kcp, bbr);
+	quantum = (IUINT32)((IUINT64)bbr->btl_bw * kcp->interval / 1000 / kcp->mtu) + 1;
+	inflight = kcp->nsnd_buf;
+
+	switch (bbr->mode) {
+	case IKCP_BBR_STARTUP:
+		if (bbr->full_reached) {
+			bbr->mode = IKCP_BBR_DRAIN;
+			bbr->pacing_gain = IKCP_BBR_DRAIN_GAIN;
+			bbr->cwnd_gain = 100;
+		}
+		break;
+	case IKCP_BBR_DRAIN:
+		if (inflight <= bdp + quantum) {
+			ikcp_bbr_enter_probe_bw(kcp, bbr);
+		}
+		break;
+	case IKCP_BBR_PROBE_BW:
+		if (_itimediff(current, bbr->cycle_ts) > (IINT32)bbr->min_rtt) {
+			bbr->cycle = (bbr->cycle + 1) % 8;
+			bbr->cycle_ts = current;
+			bbr->pacing_gain = ikcp_bbr_cycle[bbr->cycle];
+		}
+		break;
+	case IKCP_BBR_PROBE_RTT:
+		// sample afresh once the queue has drained, for at least 200ms
+		if (bbr->probe_rtt_ts == 0) {
+			if (inflight <= IKCP_BBR_MIN_CWND) {
+				bbr->probe_rtt_ts = current;
+				bbr->prev_min_rtt = bbr->min_rtt;
+				bbr->min_rtt = 0xffffffff;
+			}
+		}
+		else if (_itimediff(current, bbr->probe_rtt_ts) >= (IINT32)IKCP_BBR_PROBE_RTT_TIME) {
+			if (bbr->min_rtt == 0xffffffff) bbr->min_rtt = bbr->prev_min_rtt;
+			bbr->min_rtt_ts = current;
+			if (bbr->full_reached) {
+				ikcp_bbr_enter_probe_bw(kcp, bbr);
+			}	else {
+				bbr->mode = IKCP_BBR_STARTUP;
+				bbr->pacing_gain = IKCP_BBR_HIGH_GAIN;
+				bbr->cwnd_gain = IKCP_BBR_HIGH_GAIN;
+			}
+		}
+		break;
+	}
+
+	bdp = ikcp_bbr_bdp(kcp, bbr);
+	target = (IUINT32)((IUINT64)bdp * bbr->cwnd_gain / 100);
+	if (bdp > 0) target += quantum;
+	if (bbr->full_reached) {
+		bbr->cwnd = _imin_(bbr->cwnd + segs, target);
+	}
+	else if (bbr->cwnd < target || bdp == 0) {
+		bbr->cwnd += segs;
+	}
+	if (bbr->cwnd < IKCP_BBR_MIN_CWND) bbr->cwnd = IKCP_BBR_MIN_CWND;
+
+	// the window counts from snd_una, segments acked beyond a hole are not
+	// in flight any more and must not stall the pipe while it is repaired
+	kcp->cwnd = (bbr->mode == IKCP_BBR_PROBE_RTT)? IKCP_BBR_MIN_CWND : bbr->cwnd;
+	kcp->cwnd += _imin_((kcp->snd_nxt - kcp->snd_una) - kcp->nsnd_buf, kcp->cwnd);
+}
+
+static IUINT32 ikcp_cc_bbr_get_cwnd(const ikcpcb *kcp)
+{
+	return kcp->cwnd;
+}
+
+static IUINT32 ikcp_cc_bbr_get_pacing_rate(const ikcpcb *kcp)
+{
+	const IKCPBBR *bbr = (const IKCPBBR*)kcp->cc_state;
+	IUINT64 rate = (IUINT64)bbr->btl_bw * bbr->pacing_gain / 100;
+	return (rate > 0xffffffff)? 0xffffffff : (IUINT32)rate;
+}
+
+const ikcpcc ikcp_cc_bbr = {
+	"bbr",
+	ikcp_cc_bbr_init,
+	ikcp_cc_bbr_release,
+	ikcp_cc_bbr_on_ack,
+	NULL,
+	NULL,
+	ikcp_cc_bbr_get_cwnd,
+	ikcp_cc_bbr_get_pacing_rate,
+};
+
 
 // read conv
 IUINT32 ikcp_getconv(const void *ptr)
@@ -279,6 +279,7 @@ struct IKCPSEG
 	IUINT32 rto;
 	IUINT32 fastack;
 	IUINT32 xmit;
+	IUINT32 heap;
 	char data[1];
 };
 
@@ -302,7 +303,14 @@ struct IKCPCB
 	struct IQUEUEHEAD snd_queue;
 	struct IQUEUEHEAD rcv_queue;
 	struct IQUEUEHEAD snd_buf;
-	struct IQUEUEHEAD rcv_buf;
+	struct IKCPSEG **snd_ring;	// snd_buf indexed by sn, slot sn & snd_mask
+	IUINT32 snd_mask;
+	struct IKCPSEG **rto_heap;	// snd_buf as a min heap on resendts
+	IUINT32 nrto_heap;
+	IUINT32 *fastlist;			// sn due for fast retransmit
+	IUINT32 nfastlist;
+	struct IKCPSEG **rcv_buf;	// ring of out of order segments, slot sn & rcv_mask
+	IUINT32 rcv_mask;
 	IUINT32 *acklist;
 	IUINT32 ackcount;
 	IUINT32 ackblock;
@@ -314,11 +322,50 @@ struct IKCPCB
 	int logmask;
 	int (*output)(const char *buf, int len, struct IKCPCB *kcp, void *user);
 	void (*writelog)(const char *log, struct IKCPCB *kcp, void *user);
+	const struct IKCPCC *cc;
+	void *cc_state;
+	IINT32 pacing_credit;
+	IUINT32 ts_pacing;
+	IUINT32 sack;				// IKCP_SACK_* negotiation state
+	IUINT32 ts_sack, sack_hello;
+	IUINT32 ack_every, ack_delay, ts_ack;
+	int ack_now;
 };
 
 
 typedef struct IKCPCB ikcpcb;
 
+
+//---------------------------------------------------------------------
+// IKCPCC: congestion control, consulted when nocwnd == 0
+//---------------------------------------------------------------------
+#define IKCP_LOSS_FAST		1	// fast retransmit, 'count' is segments resent
+#define IKCP_LOSS_TIMEOUT	2	// rto expired, 'count' is the window in use
+
+struct IKCPCC
+{
+	const char *name;
+	// setup / free private state in kcp->cc_state, returns below zero for error
+	int (*init)(struct IKCPCB *kcp);
+	void (*release)(struct IKCPCB *kcp);
+	// end of ikcp_input: segments / bytes (with header) removed from snd_buf,
+	// 'rtt' is the latest sample or below zero, 'prev_una' snd_una before it
+	void (*on_ack)(struct IKCPCB *kcp, IUINT32 prev_una, IUINT32 segs,
+		IUINT32 bytes, IINT32 rtt);
+	// ikcp_flush retransmitted segments
+	void (*on_loss)(struct IKCPCB *kcp, int kind, IUINT32 count);
+	// end of ikcp_flush: data bytes (with header) put on the wire
+	void (*on_send)(struct IKCPCB *kcp, IUINT32 bytes);
+	// congestion window in segments
+	IUINT32 (*get_cwnd)(const struct IKCPCB *kcp);
+	// bytes per second the output should be paced at, 0 for unpaced
+	IUINT32 (*get_pacing_rate)(const struct IKCPCB *kcp);
+};
+
+typedef struct IKCPCC ikcpcc;
+
+struct iovec;
+
 #define IKCP_LOG_OUTPUT			1
 #define IKCP_LOG_INPUT			2
 #define IKCP_LOG_SEND			4
@@ -355,9 +402,26 @@ void ikcp_setoutput(ikcpcb *kcp, int (*output)(const char *buf, int len,
 // user/upper level recv: returns size, returns below zero for EAGAIN
 int ikcp_recv(ikcpcb *kcp, char *buffer, int len);
 
+// user/upper level recv without copy: moves the segments of the next
+// message from rcv_queue to the tail of 'queue', returns message size,
+// returns below zero for EAGAIN. release them with ikcp_segment_release
+int ikcp_recv_detach(ikcpcb *kcp, struct IQUEUEHEAD *queue);
+
+// release a segment detached by ikcp_recv_detach
+void ikcp_segment_release(struct IKCPSEG *seg);
+
 // user/upper level send, returns below zero for error
 int ikcp_send(ikcpcb *kcp, const char *buffer, int len);
 
+// build the segments of a message from a gather list and append them to
+// 'queue'. snd_queue is not touched, so it can run on another thread.
+// returns number of segments, returns below zero for error
+int ikcp_segments_build(ikcpcb *kcp, const struct iovec *iov, int iovcnt,
+	struct IQUEUEHEAD *queue);
+
+// move segments built by ikcp_segments_build to snd_queue, returns count
+int ikcp_send_segments(ikcpcb *kcp, struct IQUEUEHEAD *queue);
+
 // update state (call it repeatedly, every 10ms-100ms), or you can ask 
 // ikcp_check when to call it again (without ikcp_input/_send calling).
 // 'current' - current timestamp in millisec. 
@@ -390,6 +454,37 @@ int ikcp_wndsize(ikcpcb *kcp, int sndwnd, int rcvwnd);
 // get how many packet is waiting to be sent
 int ikcp_waitsnd(const ikcpcb *kcp);
 
+// returns 1 when nothing is waiting to be sent, acked or probed: 
+// ikcp_update need not be called again before the next ikcp_send/_input
+int ikcp_idle(const ikcpcb *kcp);
+
+// select congestion control, takes effect when nocwnd == 0. 
+// ikcp_cc_default: the original loss based cwnd/ssthresh scheme
+// ikcp_cc_bbr: delivery rate and min rtt model, loss is not a signal
+// returns below zero for error, the previous controller is kept
+int ikcp_setcc(ikcpcb *kcp, const ikcpcc *cc);
+
+// pacing rate suggested by the congestion control, 0 for unpaced
+IUINT32 ikcp_pacing_rate(const ikcpcb *kcp);
+
+extern const ikcpcc ikcp_cc_default;
+extern const ikcpcc ikcp_cc_bbr;
+
+// selective ack: acknowledges are sent as one IKCP_CMD_SACK carrying the
+// received sn ranges instead of one IKCP_CMD_ACK per segment. both sides
+// announce support in the frg byte of their control segments, which old
+// versions ignore, so ranges are only sent once the peer has announced.
+// enable: 0:disable(default), 1:enable
+int ikcp_setsack(ikcpcb *kcp, int enable);
+
+// delayed ack: hold acknowledges until 'every' segments arrived or the
+// oldest waited 'delay' ms. out of order segments, duplicates and any
+// outgoing data or probe flush them at once. the delay is checked on
+// ikcp_update, so it is rounded up to the interval
+// every: 0/1:ack on each flush(default), >1:segments per ack
+// delay: max ms an ack is held, 0:40ms(default)
+int ikcp_ackdelay(ikcpcb *kcp, int every, int delay);
+
 // fastest: ikcp_nodelay(kcp, 1, 20, 2, 1)
 // nodelay: 0:disable(default), 1:enable
 // interval: internal update timer interval in millisec, default is 100ms 
@@ -6,27 +6,205 @@
  ************************************************************************/
 
 #include "kcp.h"
+#include "kuring.h"
 #include <utils/utils.h>
 #include <utils/exception.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/sock_diag.h>
 #include <log/log.h>
+#include <vector>
 
 #define LOG_TAG "Kcp"
 
+#define UDP_GSO_MAX_SEGMENTS    64      // 内核单次GSO最多切分的段数
+#define UDP_GSO_MAX_BYTES       65507   // UDP负载上限
+#define UDP_GRO_MAX_BYTES       65535   // GRO合并后的数据报上限
+#define UDP_GRO_CONTROL_SIZE    CMSG_SPACE(sizeof(int))
+
+// 单调时钟(微秒), 用于节拍器令牌桶与更新的到期时间
+static uint64_t monotonicUs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 从UDP_GRO控制消息中取出合并前的段长, 未合并时返回0
+static int32_t groSegmentSize(msghdr *msg)
+{
+    for (cmsghdr *cm = CMSG_FIRSTHDR(msg); cm != nullptr; cm = CMSG_NXTHDR(msg, cm)) {
+        if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+            int segSize = 0;
+            memcpy(&segSize, CMSG_DATA(cm), sizeof(segSize));
+            return segSize;
+        }
+    }
+    return 0;
+}
+
+// recvmmsg接收槽, 每个线程一份, 由绑定到该线程的所有kcp复用
+struct RecvSlots
+{
+    std::vector<mmsghdr>        msgs;
+    std::vector<iovec>          iovs;
+    std::vector<sockaddr_in>    addrs;
+    std::vector<char>           buffer;
+    std::vector<char>           controls;
+    uint32_t                    slotSize = 0;
+
+    void prepare(uint32_t count, uint32_t size, bool withControl)
+    {
+        if (count > msgs.size() || size > slotSize) {
+            slotSize = size > slotSize ? size : slotSize;
+            count = count > msgs.size() ? count : msgs.size();
+            msgs.resize(count);
+            iovs.resize(count);
+            addrs.resize(count);
+            buffer.resize(count * slotSize);
+            controls.resize(count * UDP_GRO_CONTROL_SIZE);
+        }
+
+        // recvmmsg会改写msg_namelen, 每次调用前需重置
+        for (uint32_t i = 0; i < count; ++i) {
+            iovs[i].iov_base = &buffer[i * slotSize];
+            iovs[i].iov_len = slotSize;
+            memset(&msgs[i], 0, sizeof(mmsghdr));
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            if (withControl) {
+                msgs[i].msg_hdr.msg_control = &controls[i * UDP_GRO_CONTROL_SIZE];
+                msgs[i].msg_hdr.msg_controllen = UDP_GRO_CONTROL_SIZE;
+            }
+        }
+    }
+};
+
+// sendmmsg发送槽, 每个线程一份, ikcp_flush期间KcpOutput将数据报暂存于此, flush结束后统一提交
+struct SendSlots
+{
+    std::vector<mmsghdr>        msgs;
+    std::vector<iovec>          iovs;
+    std::vector<char>           buffer;
+    uint32_t                    slotSize = 0;
+    uint32_t                    capacity = 0;
+    uint32_t                    count = 0;
+    const Kcp                   *owner = nullptr;   // 当前暂存数据所属kcp
+
+    void prepare(const Kcp *kcp, uint32_t cap, uint32_t size)
+    {
+        if (cap > msgs.size() || size > slotSize) {
+            slotSize = size > slotSize ? size : slotSize;
+            uint32_t n = cap > msgs.size() ? cap : msgs.size();
+            msgs.resize(n);
+            iovs.resize(n);
+            buffer.resize(n * slotSize);
+        }
+        owner = kcp;
+        capacity = cap;
+        count = 0;
+    }
+
+    bool push(const char *buf, int32_t len)
+    {
+        if (count >= capacity || static_cast<uint32_t>(len) > slotSize) {
+            return false;
+        }
+
+        char *slot = &buffer[count * slotSize];
+        memcpy(slot, buf, len);
+        iovs[count].iov_base = slot;
+        iovs[count].iov_len = len;
+        ++count;
+        return true;
+    }
+};
+
+// GSO聚合缓冲, 每个线程一份, ikcp_flush期间将等长数据报首尾相接写入, 由内核按segSize切分
+struct GsoBuffer
+{
+    std::vector<char>           buffer;
+    uint32_t                    used = 0;
+    uint32_t                    segSize = 0;
+    uint32_t                    count = 0;
+    const Kcp                   *owner = nullptr;
+
+    void prepare(const Kcp *kcp)
+    {
+        if (buffer.size() < UDP_GSO_MAX_BYTES) {
+            buffer.resize(UDP_GSO_MAX_BYTES);
+        }
+        owner = kcp;
+        used = 0;
+        segSize = 0;
+        count = 0;
+    }
+
+    // 能否追加在当前段序列之后: 段长不能超过首段, 且短段只能是最后一段
+    bool acceptable(int32_t len) const
+    {
+        return count == 0 ||
+            (static_cast<uint32_t>(len) <= segSize &&
+             count < UDP_GSO_MAX_SEGMENTS &&
+             used + len <= buffer.size());
+    }
+
+    void append(const char *buf, int32_t len)
+    {
+        if (count == 0) {
+            segSize = len;
+        }
+        memcpy(&buffer[used], buf, len);
+        used += len;
+        ++count;
+    }
+};
+
+static thread_local RecvSlots gRecvSlots;
+static thread_local std::vector<char> gRecvBuffer(UDP_GRO_MAX_BYTES);
+static thread_local SendSlots gSendSlots;
+static thread_local GsoBuffer gGsoBuffer;
+
 // TODO 增加心跳检测
 
 Kcp::Kcp() :
     mKcpHandle(nullptr),
-    mRecvEvent(nullptr)
+    mBindTid(0),
+    mRecvEvent(nullptr),
+    mPendingSegments(0),
+    mWaitSnd(0),
+    mWriteBlocked(false),
+    mUpdateDue(0),
+    mPacedPackets(0),
+    mPacingRate(0),
+    mRecvCalls(0),
+    mRecvPackets(0),
+    mSendCalls(0),
+    mSendPackets(0),
+    mJunkDrops(0)
 {
 
 }
 
 Kcp::Kcp(const KcpAttr &attr) :
-    mAttr(attr),
     mKcpHandle(nullptr),
-    mRecvEvent(nullptr)
+    mBindTid(0),
+    mAttr(attr),
+    mRecvEvent(nullptr),
+    mPendingSegments(0),
+    mWaitSnd(0),
+    mWriteBlocked(false),
+    mUpdateDue(0),
+    mPacedPackets(0),
+    mPacingRate(0),
+    mRecvCalls(0),
+    mRecvPackets(0),
+    mSendCalls(0),
+    mSendPackets(0),
+    mJunkDrops(0)
 {
     if (init() == false) {
         throw eular::Exception("Kcp(const KcpAttr &attr) init error.");
@@ -35,6 +213,16 @@ Kcp::Kcp(const KcpAttr &attr) :
 
 Kcp::~Kcp()
 {
+    if (mSendQueue) {
+        IQUEUEHEAD segments;
+        iqueue_init(&segments);
+        takePending(&segments);
+        while (!iqueue_is_empty(&segments)) {
+            IKCPSEG *seg = iqueue_entry(segments.next, IKCPSEG, node);
+            iqueue_del(&seg->node);
+            ikcp_segment_release(seg);
+        }
+    }
     if (mKcpHandle) {
         ikcp_release(mKcpHandle);
         mKcpHandle = nullptr;
@@ -45,21 +233,212 @@ Kcp::~Kcp()
     }
 }
 
+KcpMessageView::KcpMessageView() :
+    mSize(0),
+    mCount(0)
+{
+    iqueue_init(&mSegments);
+}
+
+KcpMessageView::~KcpMessageView()
+{
+    release();
+}
+
+KcpMessageView::KcpMessageView(KcpMessageView &&other) :
+    mSize(0),
+    mCount(0)
+{
+    iqueue_init(&mSegments);
+    take(other);
+}
+
+KcpMessageView &KcpMessageView::operator=(KcpMessageView &&other)
+{
+    if (this != &other) {
+        release();
+        take(other);
+    }
+    return *this;
+}
+
+// 链表头以地址链接, 移动时需把首尾节点改挂到本对象
+void KcpMessageView::take(KcpMessageView &other)
+{
+    if (!iqueue_is_empty(&other.mSegments)) {
+        mSegments.next = other.mSegments.next;
+        mSegments.prev = other.mSegments.prev;
+        mSegments.next->prev = &mSegments;
+        mSegments.prev->next = &mSegments;
+        iqueue_init(&other.mSegments);
+    }
+    mSize = other.mSize;
+    mCount = other.mCount;
+    other.mSize = 0;
+    other.mCount = 0;
+}
+
+/**
+ * @brief 以(指针, 长度)列表形式取出分片, 可直接用于writev/sendmsg
+ *
+ * @return 填充的iovec个数
+ */
+uint32_t KcpMessageView::fragments(iovec *iov, uint32_t count) const
+{
+    uint32_t i = 0;
+    for (const IQUEUEHEAD *p = mSegments.next; p != &mSegments && i < count; p = p->next, ++i) {
+        IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
+        iov[i].iov_base = seg->data;
+        iov[i].iov_len = seg->len;
+    }
+    return i;
+}
+
+size_t KcpMessageView::copyTo(void *buf, size_t len) const
+{
+    size_t offset = 0;
+    for (const IQUEUEHEAD *p = mSegments.next; p != &mSegments && offset < len; p = p->next) {
+        IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
+        size_t n = seg->len < len - offset ? seg->len : len - offset;
+        memcpy(static_cast<char *>(buf) + offset, seg->data, n);
+        offset += n;
+    }
+    return offset;
+}
+
+void KcpMessageView::release()
+{
+    while (!iqueue_is_empty(&mSegments)) {
+        IKCPSEG *seg = iqueue_entry(mSegments.next, IKCPSEG, node);
+        iqueue_del(&seg->node);
+        ikcp_segment_release(seg);
+    }
+    mSize = 0;
+    mCount = 0;
+}
+
 bool Kcp::installRecvEvent(Callback onRecvEvent)
 {
     mRecvEvent.swap(onRecvEvent);
     return true;
 }
 
+/**
+ * @brief 安装批量接收回调, 每次读事件将rcv_queue中全部完整消息一次性交给应用. 安装后优先于installRecvEvent
+ */
+bool Kcp::installRecvBatchEvent(BatchCallback onRecvBatchEvent)
+{
+    mRecvBatchEvent.swap(onRecvBatchEvent);
+    return true;
+}
+
+/**
+ * @brief 安装零拷贝接收回调, 消息以KcpMessageView交付, 不分配也不拷贝. 安装后优先于其他接收回调
+ */
+bool Kcp::installRecvViewEvent(ViewCallback onRecvViewEvent)
+{
+    mRecvViewEvent.swap(onRecvViewEvent);
+    return true;
+}
+
+/**
+ * @brief 安装可写回调, send返回WOULD_BLOCK后, 待waitsnd降到低水位以下时在所属线程回调一次
+ */
+bool Kcp::installWritableEvent(WritableCallback onWritableEvent)
+{
+    mWritableEvent.swap(onWritableEvent);
+    return true;
+}
+
 /**
  * @brief 发送数据。做缓存队列，如果直接调用ikcp_send时发的太快会使后面的数据丢失
  * 
  * @param buffer 
  */
-void Kcp::send(const eular::ByteBuffer &buffer)
+KcpSendResult Kcp::send(const eular::ByteBuffer &buffer)
+{
+    iovec iov;
+    iov.iov_base = const_cast<uint8_t *>(buffer.const_data());
+    iov.iov_len = buffer.size();
+    return sendv(&iov, 1);
+}
+
+KcpSendResult Kcp::send(eular::ByteBuffer &&buffer)
 {
-    eular::AutoLock<eular::Mutex> lock(mQueueMutex);
-    mSendBufQueue.push_back(buffer);
+    KcpSendResult ret = send(static_cast<const eular::ByteBuffer &>(buffer));
+    if (ret == KcpSendResult::OK) {
+        buffer.clear();
+    }
+    return ret;
+}
+
+/**
+ * @brief 聚合发送, 数据在调用线程直接切分拷贝进kcp分片(仅此一次拷贝), 经无锁队列交给所属线程移入snd_queue.
+ *        可在多个线程并发调用
+ *
+ * @return 队列满返回QUEUE_FULL, 消息过大(分片数超过IKCP_WND_RCV)或内存不足返回FAILED,
+ *         排队分片数达到高水位返回WOULD_BLOCK
+ */
+KcpSendResult Kcp::sendv(const iovec *iov, int iovcnt)
+{
+    if (mKcpHandle == nullptr || mSendQueue == nullptr) {
+        return KcpSendResult::FAILED;
+    }
+
+    if (mAttr.sendHighWater > 0 &&
+        mPendingSegments.load(std::memory_order_relaxed) + mWaitSnd.load(std::memory_order_relaxed) >= mAttr.sendHighWater) {
+        // 读到的水位可能已过时, 所属线程此前的checkWritable未见到阻塞标记且会话可能已空闲,
+        // 置位后再安排一次更新, 保证所属线程至少再检查一次水位
+        mWriteBlocked.store(true);
+        markDirty(0);
+        return KcpSendResult::WOULD_BLOCK;
+    }
+
+    // 低延迟模式下所属线程直接写入snd_queue并立即flush, 不经过队列和定时器
+    if (mAttr.lowLatency && mBindTid == static_cast<uint32_t>(gettid())) {
+        movePending();
+        IQUEUEHEAD segments;
+        iqueue_init(&segments);
+        int ret = ikcp_segments_build(mKcpHandle, iov, iovcnt, &segments);
+        if (ret < 0) {
+            LOGE("ikcp_segments_build error. %d", ret);
+            return KcpSendResult::FAILED;
+        }
+        ikcp_send_segments(mKcpHandle, &segments);
+        flushOutput(true);
+        checkWritable();
+        uint32_t delay = nextUpdateDelay();   // 重传仍由ikcp_check安排
+        if (delay != UINT32_MAX) {
+            markDirty(delay);
+        }
+        return KcpSendResult::OK;
+    }
+
+    // 先预留槽位再切分, 队列满时不做无用的分配与拷贝; 切分失败则发布空消息由消费者跳过
+    int ret = 0;
+    bool queued = mSendQueue->push([&] (PendingMessage &msg) {
+        IQUEUEHEAD segments;
+        iqueue_init(&segments);
+        ret = ikcp_segments_build(mKcpHandle, iov, iovcnt, &segments);
+        if (ret < 0) {
+            msg.first = msg.last = nullptr;
+            return;
+        }
+        msg.first = iqueue_entry(segments.next, IKCPSEG, node);
+        msg.last = iqueue_entry(segments.prev, IKCPSEG, node);
+        msg.count = ret;
+        mPendingSegments.fetch_add(ret, std::memory_order_relaxed);
+    });
+
+    if (!queued) {
+        return KcpSendResult::QUEUE_FULL;
+    }
+    if (ret < 0) {
+        LOGE("ikcp_segments_build error. %d", ret);
+        return KcpSendResult::FAILED;
+    }
+    markDirty(0);
+    return KcpSendResult::OK;
 }
 
 bool Kcp::setAttr(const KcpAttr &attr)
@@ -76,6 +455,20 @@ uint32_t Kcp::check()
     return ikcp_check(mKcpHandle, Time::Abstime());
 }
 
+KcpStats Kcp::getStats() const
+{
+    KcpStats stats;
+    stats.recvCalls = mRecvCalls.load(std::memory_order_relaxed);
+    stats.recvPackets = mRecvPackets.load(std::memory_order_relaxed);
+    stats.sendCalls = mSendCalls.load(std::memory_order_relaxed);
+    stats.sendPackets = mSendPackets.load(std::memory_order_relaxed);
+    stats.junkDrops = mJunkDrops.load(std::memory_order_relaxed);
+    stats.socketDrops = SocketDrops(mAttr.fd);
+    stats.pacedPackets = mPacedPackets.load(std::memory_order_relaxed);
+    stats.pacingRate = mPacingRate.load(std::memory_order_relaxed);
+    return stats;
+}
+
 bool Kcp::init()
 {
     mKcpHandle = ikcp_create(mAttr.conv, this);
@@ -83,9 +476,21 @@ bool Kcp::init()
         return false;
     }
 
+    mSendQueue.reset(new (std::nothrow) KMpscQueue<PendingMessage>(mAttr.sendQueueSize));
+    if (mSendQueue == nullptr) {
+        ikcp_release(mKcpHandle);
+        mKcpHandle = nullptr;
+        return false;
+    }
+
     ikcp_setoutput(mKcpHandle, &Kcp::KcpOutput);
     ikcp_wndsize(mKcpHandle, mAttr.sendWndSize, mAttr.recvWndSize);
-    ikcp_nodelay(mKcpHandle, mAttr.nodelay, mAttr.interval, mAttr.fastResend, 1);
+    ikcp_nodelay(mKcpHandle, mAttr.nodelay, mAttr.interval, mAttr.fastResend, mAttr.congestion ? 0 : 1);
+    if (mAttr.congestion == 2 && ikcp_setcc(mKcpHandle, &ikcp_cc_bbr) < 0) {
+        LOGW("ikcp_setcc(bbr) error, fall back to the default congestion control");
+    }
+    ikcp_setsack(mKcpHandle, mAttr.sack);
+    ikcp_ackdelay(mKcpHandle, mAttr.ackEvery, mAttr.ackDelay);
     return true;
 }
 
@@ -99,7 +504,42 @@ int Kcp::KcpOutput(const char *buf, int len, ikcpcb *kcp, void *user)
 {
     Kcp *__kcp = static_cast<Kcp *>(user);
     if (buf && len > 0) {
+        if (__kcp->pacingEnabled() && !__kcp->mPacer.draining && !__kcp->paceAdmit(buf, len)) {
+            return len;     // 已暂存, 由节拍器按速率释放
+        }
+
         LOGD("kcp callback. sendto [%s:%d] len %d", inet_ntoa(__kcp->mAttr.addr.sin_addr), ntohs(__kcp->mAttr.addr.sin_port), len);
+        GsoBuffer &gso = gGsoBuffer;
+        if (gso.owner == __kcp) {
+            if (!gso.acceptable(len)) {
+                __kcp->sendGso();
+            }
+            gso.append(buf, len);
+            if (static_cast<uint32_t>(len) < gso.segSize) {
+                __kcp->sendGso();
+            }
+            return len;
+        }
+
+        SendSlots &slots = gSendSlots;
+        if (slots.owner == __kcp) {
+            if (slots.count >= slots.capacity) {
+                __kcp->sendBatch();
+            }
+            if (slots.push(buf, len)) {
+                return len;
+            }
+        }
+
+        // io_uring引擎下排队为sendmsg SQE, 随本线程下一次io_uring_enter一并提交
+        KUring *uring = KUring::Current();
+        if (uring != nullptr && uring->queueSend(__kcp->mAttr.fd, __kcp->mAttr.addr, buf, len)) {
+            __kcp->mSendPackets.fetch_add(1, std::memory_order_relaxed);
+            return len;
+        }
+
+        __kcp->mSendCalls.fetch_add(1, std::memory_order_relaxed);
+        __kcp->mSendPackets.fetch_add(1, std::memory_order_relaxed);
         return ::sendto(__kcp->mAttr.fd, buf, len, 0, (sockaddr *)&__kcp->mAttr.addr, sizeof(sockaddr_in));
     }
 
@@ -109,62 +549,608 @@ int Kcp::KcpOutput(const char *buf, int len, ikcpcb *kcp, void *user)
 void Kcp::inputRoutine()
 {
     LOGD("----------> begin <----------");
-    char buf[2 * 1400] = {0};
+    if (mAttr.recvBatch > 1) {
+        recvBatch();
+    } else {
+        recvOnce();
+    }
+
+    recvMessage();
+    if (mAttr.lowLatency) {     // 本批输入产生的ACK立即发出
+        flushOutput(true);
+    }
+    checkWritable();
+    LOGD("----------> end <----------");
+}
+
+/**
+ * @brief 取出rcv_queue中全部完整消息, 避免消息滞留到下一个数据报到达
+ */
+void Kcp::recvMessage()
+{
+    if (mRecvViewEvent) {
+        recvMessageView();
+        return;
+    }
+    if (mRecvEvent == nullptr && mRecvBatchEvent == nullptr) {
+        return;
+    }
+
+    int32_t ret = 0;
+    while ((ret = ikcp_peeksize(mKcpHandle)) > 0) {
+        eular::ByteBuffer buffer(ret);
+        int32_t nrecv = ikcp_recv(mKcpHandle, (char *)buffer.data(), ret);
+        LOGD("ikcp_recv size %d", nrecv);
+        if (nrecv <= 0) {
+            break;
+        }
+        buffer.resize(nrecv);
+
+        if (mRecvBatchEvent) {
+            mRecvMessages.push_back(std::move(buffer));
+        } else {
+            mRecvEvent(buffer, mAttr.addr);
+        }
+    }
+
+    if (mRecvBatchEvent && !mRecvMessages.empty()) {
+        mRecvBatchEvent(mRecvMessages, mAttr.addr);
+        mRecvMessages.clear();
+    }
+}
+
+void Kcp::recvMessageView()
+{
+    while (ikcp_peeksize(mKcpHandle) > 0) {
+        KcpMessageView view;
+        int32_t size = ikcp_recv_detach(mKcpHandle, &view.mSegments);
+        if (size < 0) {
+            break;
+        }
+
+        for (IQUEUEHEAD *p = view.mSegments.next; p != &view.mSegments; p = p->next) {
+            ++view.mCount;
+        }
+        view.mSize = size;
+        LOGD("ikcp_recv_detach size %d, fragments %u", size, view.mCount);
+        mRecvViewEvent(view, mAttr.addr);
+    }
+}
+
+void Kcp::recvOnce()
+{
+    std::vector<char> &buf = gRecvBuffer;
+    char control[UDP_GRO_CONTROL_SIZE];
     sockaddr_in peerAddr;
-    socklen_t len = sizeof(sockaddr_in);
+    iovec iov;
+    msghdr msg;
 
     while (true) {
-        int32_t nrecv = ::recvfrom(mAttr.fd, buf, sizeof(buf), 0, (sockaddr *)&peerAddr, &len);
+        iov.iov_base = buf.data();
+        iov.iov_len = buf.size();
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &peerAddr;
+        msg.msg_namelen = sizeof(sockaddr_in);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if (mAttr.udpGro) {
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+        }
+
+        int32_t nrecv = ::recvmsg(mAttr.fd, &msg, 0);
         if (nrecv < 0) {
             if (errno != EAGAIN) {
-                LOGE("recvfrom error. [%d,%s]", error, strerror(errno));
+                LOGE("recvmsg error. [%d,%s]", errno, strerror(errno));
             }
 
             break;
         }
-        LOGD("recvfrom [%s:%d] size %zu", inet_ntoa(peerAddr.sin_addr), ntohs(peerAddr.sin_port), nrecv);
-        int32_t conv = ikcp_getconv(buf);
-        if (conv != mAttr.conv)
-        {
-            LOGE("conv(%d) != self_conv(%d)", conv, mAttr.conv);
+        mRecvCalls.fetch_add(1, std::memory_order_relaxed);
+        if (msg.msg_flags & MSG_TRUNC) {
+            LOGE("datagram truncated, larger than %zu", iov.iov_len);
             continue;
         }
-        mAttr.addr = peerAddr;
+        inputDatagram(buf.data(), nrecv, peerAddr, mAttr.udpGro ? groSegmentSize(&msg) : 0);
+    }
+}
 
-        int32_t ret = ikcp_input(mKcpHandle, buf, nrecv);
-        if (ret < 0) {
-            LOGE("ikcp_input error. %d", ret);
+/**
+ * @brief 使用recvmmsg一次读取最多recvBatch个数据报, 直到读空socket
+ */
+void Kcp::recvBatch()
+{
+    RecvSlots &slots = gRecvSlots;
+    uint32_t batch = mAttr.recvBatch;
+
+    while (true) {
+        slots.prepare(batch, mAttr.udpGro ? UDP_GRO_MAX_BYTES : mKcpHandle->mtu, mAttr.udpGro);
+        int32_t nmsgs = ::recvmmsg(mAttr.fd, slots.msgs.data(), batch, 0, nullptr);
+        if (nmsgs < 0) {
+            if (errno != EAGAIN) {
+                LOGE("recvmmsg error. [%d,%s]", errno, strerror(errno));
+            }
+
+            break;
+        }
+        mRecvCalls.fetch_add(1, std::memory_order_relaxed);
+
+        for (int32_t i = 0; i < nmsgs; ++i) {
+            mmsghdr &msg = slots.msgs[i];
+            if (msg.msg_hdr.msg_flags & MSG_TRUNC) {
+                LOGE("datagram truncated, larger than %u", slots.slotSize);
+                continue;
+            }
+            inputDatagram((const char *)slots.iovs[i].iov_base, msg.msg_len, slots.addrs[i],
+                mAttr.udpGro ? groSegmentSize(&msg.msg_hdr) : 0);
+        }
+
+        if (static_cast<uint32_t>(nmsgs) < batch) {  // 已读空
+            break;
+        }
+    }
+}
+
+/**
+ * @brief 将GRO合并的数据报按段长拆回单个kcp数据报, segSize为0表示未合并
+ */
+void Kcp::inputDatagram(const char *buf, int32_t len, const sockaddr_in &peerAddr, int32_t segSize)
+{
+    if (segSize <= 0 || segSize >= len) {
+        mRecvPackets.fetch_add(1, std::memory_order_relaxed);
+        inputPacket(buf, len, peerAddr);
+        return;
+    }
+
+    for (int32_t offset = 0; offset < len; offset += segSize) {
+        int32_t size = len - offset < segSize ? len - offset : segSize;
+        mRecvPackets.fetch_add(1, std::memory_order_relaxed);
+        inputPacket(buf + offset, size, peerAddr);
+    }
+}
+
+/**
+ * @brief io_uring多发recvmsg完成的数据报, 由KUring在所属线程回调
+ */
+void Kcp::inputFromRing(const char *buf, int32_t len, const sockaddr_in &peerAddr)
+{
+    mRecvCalls.fetch_add(1, std::memory_order_relaxed);
+    inputDatagram(buf, len, peerAddr, 0);
+    recvMessage();
+    if (mAttr.lowLatency) {
+        flushOutput(true);
+    }
+    checkWritable();
+}
+
+void Kcp::inputPacket(const char *buf, int32_t len, const sockaddr_in &peerAddr)
+{
+    LOGD("recvfrom [%s:%d] size %d", inet_ntoa(peerAddr.sin_addr), ntohs(peerAddr.sin_port), len);
+    if (len < (int32_t)sizeof(uint32_t)) {
+        mJunkDrops.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint32_t conv = ikcp_getconv(buf);
+    if (conv != mAttr.conv) {
+        LOGE("conv(%u) != self_conv(%u)", conv, mAttr.conv);
+        mJunkDrops.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    mAttr.addr = peerAddr;
+
+    int32_t ret = ikcp_input(mKcpHandle, buf, len);
+    if (ret < 0) {
+        LOGE("ikcp_input error. %d", ret);
+    }
+
+    // 已安排更新时不必重复计算ikcp_check
+    if (mUpdateDue.load(std::memory_order_relaxed) == 0) {
+        uint32_t delay = nextUpdateDelay();
+        if (delay != UINT32_MAX) {
+            markDirty(delay);
+        }
+    }
+}
+
+/**
+ * @brief 取出发送队列中全部消息, 按入队顺序将分片链接到segments尾部. 仅所属线程调用
+ *
+ * @return 取出的分片数
+ */
+uint32_t Kcp::takePending(IQUEUEHEAD *segments)
+{
+    uint32_t count = 0;
+    PendingMessage msg;
+    while (mSendQueue->pop(msg)) {
+        if (msg.first == nullptr) {
             continue;
         }
+        count += msg.count;
+        IQUEUEHEAD *tail = segments->prev;
+        tail->next = &msg.first->node;
+        msg.first->node.prev = tail;
+        msg.last->node.next = segments;
+        segments->prev = &msg.last->node;
     }
+    return count;
+}
 
-    int32_t ret = ikcp_peeksize(mKcpHandle);
-    if (ret > 0) {
-        eular::ByteBuffer buffer(ret);
-        int32_t nrecv = ikcp_recv(mKcpHandle, (char *)buffer.data(), ret);
-        LOGD("ikcp_recv size %d", nrecv);
-        if (nrecv > 0) {
-            buffer.resize(nrecv);
-            mRecvEvent(buffer, peerAddr);
+void Kcp::setUpdateHook(UpdateHook hook)
+{
+    eular::AutoLock<eular::Mutex> lock(mHookMutex);
+    mUpdateHook.swap(hook);
+}
+
+bool Kcp::hasUpdateHook()
+{
+    eular::AutoLock<eular::Mutex> lock(mHookMutex);
+    return mUpdateHook != nullptr;
+}
+
+/**
+ * @brief 会话有新数据待处理, 请求所属线程在delayMs后调用outputRoutine. 已安排的更新不晚于此时不重复安排,
+ *        晚于此时则提前(旧定时器到期后由beginUpdate丢弃). 可在任意线程调用
+ */
+void Kcp::markDirty(uint32_t delayMs)
+{
+    uint64_t due = monotonicUs() / 1000 + delayMs;
+    uint64_t armed = mUpdateDue.load();
+    while (armed == 0 || due < armed) {
+        if (!mUpdateDue.compare_exchange_weak(armed, due)) {
+            continue;
+        }
+
+        eular::AutoLock<eular::Mutex> lock(mHookMutex);
+        if (mUpdateHook) {
+            mUpdateHook(delayMs, due);
+        } else {
+            mUpdateDue.compare_exchange_strong(due, 0);
+        }
+        return;
+    }
+}
+
+/**
+ * @brief 更新定时器到期时调用, 只有最近一次安排的定时器有效
+ */
+bool Kcp::beginUpdate(uint64_t due)
+{
+    return mUpdateDue.compare_exchange_strong(due, 0);
+}
+
+bool Kcp::idle() const
+{
+    return ikcp_idle(mKcpHandle) && mPendingSegments.load(std::memory_order_relaxed) == 0 &&
+        mPacer.queue.empty();
+}
+
+/**
+ * @brief 由ikcp_check计算距下一次ikcp_update的毫秒数, 空闲返回UINT32_MAX. 仅所属线程调用
+ */
+uint32_t Kcp::nextUpdateDelay()
+{
+    if (idle()) {
+        return UINT32_MAX;
+    }
+
+    IUINT32 current = Time::Abstime();
+    return ikcp_check(mKcpHandle, current) - current;
+}
+
+/**
+ * @brief 刷新waitsnd供send判断水位, 曾返回WOULD_BLOCK且已降到低水位以下时触发可写回调. 仅所属线程调用
+ */
+void Kcp::checkWritable()
+{
+    if (mAttr.sendHighWater == 0) {
+        return;
+    }
+
+    uint32_t waitsnd = ikcp_waitsnd(mKcpHandle);
+    mWaitSnd.store(waitsnd, std::memory_order_relaxed);
+
+    uint32_t lowWater = mAttr.sendLowWater ? mAttr.sendLowWater : mAttr.sendHighWater / 2;
+    if (waitsnd + mPendingSegments.load(std::memory_order_relaxed) < lowWater &&
+        mWriteBlocked.exchange(false)) {
+        if (mWritableEvent) {
+            mWritableEvent();
         }
     }
-    LOGD("----------> end <----------");
 }
 
 void Kcp::outputRoutine()
 {
-    std::list<eular::ByteBuffer> queue;
-    {
-        eular::AutoLock<eular::Mutex> lock(mQueueMutex);
-        queue = std::move(mSendBufQueue);
+    movePending();
+    flushOutput(false);
+    checkWritable();
+}
+
+/**
+ * @brief 将发送队列中的消息移入snd_queue. 仅所属线程调用
+ */
+void Kcp::movePending()
+{
+    IQUEUEHEAD segments;
+    iqueue_init(&segments);
+    uint32_t count = takePending(&segments);
+    ikcp_send_segments(mKcpHandle, &segments);
+    // 先计入waitsnd再扣减队列计数, 生产者只会短暂高估排队量
+    mWaitSnd.store(ikcp_waitsnd(mKcpHandle), std::memory_order_relaxed);
+    mPendingSegments.fetch_sub(count, std::memory_order_relaxed);
+}
+
+/**
+ * @brief 按出口模式(GSO/sendmmsg/sendto)输出. immediate为true时直接ikcp_flush, 否则由ikcp_update按interval决定是否flush
+ */
+void Kcp::flushOutput(bool immediate)
+{
+    if (mAttr.udpGso) {
+        gGsoBuffer.prepare(this);
+    } else if (mAttr.sendBatch > 1) {
+        gSendSlots.prepare(this, mAttr.sendBatch, mKcpHandle->mtu);
     }
 
-    for (auto it : queue) {
-        int ret = ikcp_send(mKcpHandle, (const char *)(it.const_data()), it.size());
-        if (ret < 0) {
-            LOGE("ikcp_send error. %d", ret);
+    drainPaced();
+    IUINT32 current = Time::Abstime();
+    if (immediate && mKcpHandle->updated) {
+        // ikcp_flush以current计算rtt与重传时间, 只有ikcp_update会刷新它, 立即发送前先更新
+        mKcpHandle->current = current;
+        ikcp_flush(mKcpHandle);
+    } else {
+        // 首次ikcp_update之前ikcp_flush不发送任何数据, 首次update会立即flush
+        ikcp_update(mKcpHandle, current);
+    }
+
+    if (gGsoBuffer.owner == this) {
+        sendGso();
+        gGsoBuffer.owner = nullptr;
+    } else if (gSendSlots.owner == this) {
+        sendBatch();
+        gSendSlots.owner = nullptr;
+    }
+
+    // 仍有暂存的数据报, 按令牌缺口安排下一次释放
+    if (!mPacer.queue.empty() && mPacer.rate > 0) {
+        double lack = mPacer.queue.front().size() - mPacer.tokens;
+        uint32_t delayMs = lack > 0 ? static_cast<uint32_t>(lack * 1000 / mPacer.rate) + 1 : 1;
+        markDirty(delayMs);
+    }
+}
+
+bool Kcp::pacingEnabled() const
+{
+    return mAttr.pacingRate > 0 || mAttr.pacingAuto;
+}
+
+/**
+ * @brief 按当前速率补充令牌. pacingAuto时优先取拥塞控制给出的速率, 否则取 窗口 * mss / srtt 的1.25倍, 均不低于pacingRate
+ */
+void Kcp::refillTokens()
+{
+    uint64_t now = monotonicUs();
+    uint64_t rate = mAttr.pacingRate;
+    uint32_t ccRate = mAttr.pacingAuto ? ikcp_pacing_rate(mKcpHandle) : 0;
+    if (ccRate > 0) {
+        rate = ccRate > rate ? ccRate : rate;
+    } else if (mAttr.pacingAuto && mKcpHandle->rx_srtt > 0) {
+        uint32_t wnd = mKcpHandle->snd_wnd < mKcpHandle->rmt_wnd ? mKcpHandle->snd_wnd : mKcpHandle->rmt_wnd;
+        if (mKcpHandle->nocwnd == 0 && mKcpHandle->cwnd < wnd) {
+            wnd = mKcpHandle->cwnd;
+        }
+        uint64_t derived = static_cast<uint64_t>(wnd) * mKcpHandle->mss * 1000 / mKcpHandle->rx_srtt * 5 / 4;
+        rate = derived > rate ? derived : rate;
+    }
+
+    uint32_t burst = mAttr.pacingBurst ? mAttr.pacingBurst : mKcpHandle->mtu * 4;
+    burst = burst < mKcpHandle->mtu ? mKcpHandle->mtu : burst;
+    if (mPacer.lastUs == 0) {
+        mPacer.tokens = burst;
+    } else {
+        mPacer.tokens += static_cast<double>(rate) * (now - mPacer.lastUs) / 1000000;
+    }
+    mPacer.tokens = mPacer.tokens > burst ? burst : mPacer.tokens;
+    mPacer.lastUs = now;
+    mPacer.rate = rate;
+    mPacingRate.store(rate, std::memory_order_relaxed);
+}
+
+/**
+ * @brief 令牌足够且无暂存数据报时放行, 否则暂存. 速率未知(pacingAuto且尚无rtt)时不限速
+ */
+bool Kcp::paceAdmit(const char *buf, int32_t len)
+{
+    refillTokens();
+    if (mPacer.rate == 0) {
+        return true;
+    }
+    if (mPacer.queue.empty() && mPacer.tokens >= len) {
+        mPacer.tokens -= len;
+        return true;
+    }
+
+    mPacer.queue.emplace_back(reinterpret_cast<const uint8_t *>(buf), len);
+    mPacedPackets.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+/**
+ * @brief 按令牌释放暂存的数据报, 经KcpOutput走当前的出口模式
+ */
+void Kcp::drainPaced()
+{
+    if (mPacer.queue.empty()) {
+        return;
+    }
+
+    refillTokens();
+    mPacer.draining = true;
+    while (!mPacer.queue.empty()) {
+        eular::ByteBuffer &front = mPacer.queue.front();
+        if (mPacer.rate > 0 && mPacer.tokens < front.size()) {
+            break;
+        }
+        if (mPacer.rate > 0) {
+            mPacer.tokens -= front.size();
         }
+        KcpOutput((const char *)front.const_data(), front.size(), mKcpHandle, this);
+        mPacer.queue.pop_front();
     }
+    mPacer.draining = false;
+}
+
+/**
+ * @brief 使用sendmmsg提交ikcp_flush期间暂存的数据报
+ */
+void Kcp::sendBatch()
+{
+    SendSlots &slots = gSendSlots;
+    uint32_t offset = 0;
+
+    while (offset < slots.count) {
+        uint32_t n = slots.count - offset;
+        for (uint32_t i = offset; i < slots.count; ++i) {
+            memset(&slots.msgs[i], 0, sizeof(mmsghdr));
+            slots.msgs[i].msg_hdr.msg_name = &mAttr.addr;
+            slots.msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            slots.msgs[i].msg_hdr.msg_iov = &slots.iovs[i];
+            slots.msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int32_t nsent = ::sendmmsg(mAttr.fd, &slots.msgs[offset], n, 0);
+        if (nsent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // 剩余数据报丢弃, 由kcp重传
+            LOGE("sendmmsg error. [%d,%s]", errno, strerror(errno));
+            break;
+        }
+        if (nsent == 0) {
+            break;
+        }
+        mSendCalls.fetch_add(1, std::memory_order_relaxed);
+        mSendPackets.fetch_add(nsent, std::memory_order_relaxed);
+        offset += nsent;
+    }
+
+    slots.count = 0;
+}
+
+/**
+ * @brief 将GSO缓冲中的等长数据报以一次sendmsg提交, 内核不支持时回退为逐个sendto
+ */
+void Kcp::sendGso()
+{
+    GsoBuffer &gso = gGsoBuffer;
+    if (gso.count == 0) {
+        return;
+    }
+
+    if (gso.count > 1) {
+        iovec iov;
+        iov.iov_base = gso.buffer.data();
+        iov.iov_len = gso.used;
+
+        char control[CMSG_SPACE(sizeof(uint16_t))] = {0};
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &mAttr.addr;
+        msg.msg_namelen = sizeof(sockaddr_in);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
 
-    ikcp_update(mKcpHandle, Time::Abstime());
+        cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t segSize = gso.segSize;
+        memcpy(CMSG_DATA(cm), &segSize, sizeof(segSize));
+
+        ssize_t nsent = ::sendmsg(mAttr.fd, &msg, 0);
+        if (nsent >= 0) {
+            mSendCalls.fetch_add(1, std::memory_order_relaxed);
+            mSendPackets.fetch_add(gso.count, std::memory_order_relaxed);
+            gso.count = 0;
+            gso.used = 0;
+            return;
+        }
+
+        if (errno != EIO && errno != EINVAL && errno != ENOPROTOOPT && errno != EOPNOTSUPP) {
+            // 剩余数据报丢弃, 由kcp重传
+            LOGE("sendmsg(UDP_SEGMENT) error. [%d,%s]", errno, strerror(errno));
+            gso.count = 0;
+            gso.used = 0;
+            return;
+        }
+
+        LOGW("UDP_SEGMENT rejected by kernel, fall back to sendto. [%d,%s]", errno, strerror(errno));
+        mAttr.udpGso = 0;
+    }
+
+    for (uint32_t offset = 0; offset < gso.used; offset += gso.segSize) {
+        uint32_t len = gso.used - offset < gso.segSize ? gso.used - offset : gso.segSize;
+        mSendCalls.fetch_add(1, std::memory_order_relaxed);
+        mSendPackets.fetch_add(1, std::memory_order_relaxed);
+        ::sendto(mAttr.fd, &gso.buffer[offset], len, 0, (sockaddr *)&mAttr.addr, sizeof(sockaddr_in));
+    }
+    gso.count = 0;
+    gso.used = 0;
+}
+
+/**
+ * @brief 挂载经典BPF套接字过滤器, 在内核中丢弃长度不足IKCP_OVERHEAD、cmd未知
+ *        或conv不在[convBase, convBase + convCount)内的数据报.
+ *        UDP套接字过滤器的数据起始于UDP头部, kcp头部位于偏移8处, conv为小端序
+ */
+bool Kcp::AttachJunkFilter(int fd, uint32_t convBase, uint32_t convCount)
+{
+    static const uint32_t UDP_HEAD = 8;
+    static const uint32_t KCP_HEAD = 24;    // IKCP_OVERHEAD
+
+    sock_filter code[] = {
+        BPF_STMT(BPF_LD  | BPF_W   | BPF_LEN, 0),
+        BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K,   UDP_HEAD + KCP_HEAD, 0, 19),
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, UDP_HEAD + 4),           // cmd
+        BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K,   81, 0, 17),              // IKCP_CMD_PUSH
+        BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K,   85, 16, 0),              // IKCP_CMD_SACK
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, UDP_HEAD + 3),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K,   8),
+        BPF_STMT(BPF_MISC| BPF_TAX,           0),
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, UDP_HEAD + 2),
+        BPF_STMT(BPF_ALU | BPF_OR  | BPF_X,   0),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K,   8),
+        BPF_STMT(BPF_MISC| BPF_TAX,           0),
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, UDP_HEAD + 1),
+        BPF_STMT(BPF_ALU | BPF_OR  | BPF_X,   0),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K,   8),
+        BPF_STMT(BPF_MISC| BPF_TAX,           0),
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, UDP_HEAD + 0),
+        BPF_STMT(BPF_ALU | BPF_OR  | BPF_X,   0),                      // A = conv
+        BPF_STMT(BPF_ALU | BPF_SUB | BPF_K,   convBase),
+        BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K,   convCount, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K,             0xFFFFFFFF),             // accept
+        BPF_STMT(BPF_RET | BPF_K,             0),                      // drop
+    };
+    sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        LOGW("setsockopt(%d, SO_ATTACH_FILTER) error. [%d, %s]", fd, errno, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+uint64_t Kcp::SocketDrops(int fd)
+{
+    uint32_t meminfo[SK_MEMINFO_VARS] = {0};
+    socklen_t len = sizeof(meminfo);
+    if (fd < 0 || getsockopt(fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) < 0) {
+        return 0;
+    }
+    return meminfo[SK_MEMINFO_DROPS];
 }
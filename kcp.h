@@ -11,11 +11,25 @@
 #include <utils/mutex.h>
 #include <utils/buffer.h>
 #include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <sys/uio.h>
 #include <stdint.h>
 #include <list>
+#include <deque>
+#include <vector>
+#include <atomic>
 #include <memory>
 #include <functional>
 #include "ikcp.h"
+#include "kqueue.h"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO     104
+#endif
 
 struct KcpAttr
 {
@@ -28,31 +42,126 @@ struct KcpAttr
     uint8_t  nodelay;       // 0:disable(default), 1:enable
     int32_t  interval;      // internal update timer interval in millisec, default is 100ms
     uint8_t  fastResend;    // 0:disable fast resend(default), >0:enable fast resend
+    uint16_t recvBatch;     // 0/1:one recvfrom per datagram(default), >1:datagrams per recvmmsg call
+    uint16_t sendBatch;     // 0/1:one sendto per datagram(default), >1:datagrams per sendmmsg call
+    uint8_t  udpGso;        // 0:disable(default), 1:coalesce equal-sized datagrams with UDP_SEGMENT, takes precedence over sendBatch
+    uint8_t  udpGro;        // 0:disable(default), 1:enable UDP_GRO and split coalesced datagrams before ikcp_input
+    uint8_t  junkFilter;    // 0:disable(default), 1:attach a socket filter dropping non-kcp datagrams in kernel
+    uint32_t sendQueueSize; // messages queued between send and the owner thread, rounded up to a power of two, default is 1024
+    uint32_t sendHighWater; // 0:disable(default), >0:send returns WOULD_BLOCK once this many segments are queued or unacked
+    uint32_t sendLowWater;  // writable event fires when waitsnd drops below it after WOULD_BLOCK, 0:half of sendHighWater(default)
+    uint8_t  lowLatency;    // 0:disable(default), 1:send on the owner thread and every input burst flush immediately
+    uint32_t pacingRate;    // 0:disable(default), >0:pace output datagrams to this many bytes per second
+    uint8_t  pacingAuto;    // 0:disable(default), 1:pace at the congestion control rate, else 1.25 * window * mss / srtt, pacingRate acts as the floor
+    uint32_t pacingBurst;   // bytes allowed to leave back to back when paced, 0:4 * mtu(default)
+    uint8_t  congestion;    // 0:disable(default), 1:kcp loss based cwnd, 2:bbr (delivery rate and min rtt)
+    uint8_t  sack;          // 0:disable(default), 1:ack with sn ranges once the peer announces support, per segment acks otherwise
+    uint16_t ackEvery;      // 0/1:ack on every update(default), >1:delay acks until this many segments arrived, out of order arrivals ack at once
+    uint16_t ackDelay;      // max millisec a delayed ack is held, rounded up to interval, 0:40ms(default)
 
     KcpAttr() :
         fd(-1), autoClose(0), conv(0),
         sendWndSize(512), recvWndSize(512),
-        nodelay(1), interval(100), fastResend(2)
+        nodelay(1), interval(100), fastResend(2),
+        recvBatch(0), sendBatch(0), udpGso(0), udpGro(0),
+        junkFilter(0), sendQueueSize(1024), sendHighWater(0), sendLowWater(0),
+        lowLatency(0), pacingRate(0), pacingAuto(0), pacingBurst(0),
+        congestion(0), sack(0), ackEvery(0), ackDelay(0)
     {
         memset(&addr, 0, sizeof(addr));
     }
 };
 
+enum class KcpSendResult
+{
+    OK = 0,
+    QUEUE_FULL,     // send queue is full, nothing was queued, try again later
+    FAILED,         // message needs too many segments or out of memory
+    WOULD_BLOCK,    // queued segments reached sendHighWater, nothing was queued, wait for the writable event
+};
+
+struct KcpStats
+{
+    uint64_t recvCalls;     // number of recvfrom/recvmmsg calls that returned data
+    uint64_t recvPackets;   // number of datagrams received
+    uint64_t sendCalls;     // number of sendto/sendmmsg calls
+    uint64_t sendPackets;   // number of datagrams sent
+    uint64_t junkDrops;     // datagrams rejected in user space (short or foreign conv)
+    uint64_t socketDrops;   // datagrams dropped by the kernel for this socket, including the junk filter
+    uint64_t pacedPackets;  // datagrams held back by the pacer before being sent
+    uint64_t pacingRate;    // current pacing rate in bytes per second, 0 when not paced
+
+    KcpStats() :
+        recvCalls(0), recvPackets(0), sendCalls(0), sendPackets(0),
+        junkDrops(0), socketDrops(0), pacedPackets(0), pacingRate(0)
+    {
+    }
+
+    double recvPacketsPerCall() const
+    {
+        return recvCalls ? static_cast<double>(recvPackets) / recvCalls : 0;
+    }
+
+    double sendPacketsPerCall() const
+    {
+        return sendCalls ? static_cast<double>(sendPackets) / sendCalls : 0;
+    }
+};
+
+/**
+ * @brief 接收消息的零拷贝视图, 直接引用rcv_queue中取下的kcp分片(IKCPSEG::data), 析构时归还分片.
+ *        只可移动, 回调中移出即可延长分片的生命周期; 持有期间分片不占用接收窗口
+ */
+class KcpMessageView
+{
+    friend class Kcp;
+public:
+    KcpMessageView();
+    ~KcpMessageView();
+    KcpMessageView(KcpMessageView &&other);
+    KcpMessageView &operator=(KcpMessageView &&other);
+    KcpMessageView(const KcpMessageView &) = delete;
+    KcpMessageView &operator=(const KcpMessageView &) = delete;
+
+    size_t size() const { return mSize; }
+    uint32_t fragmentCount() const { return mCount; }
+    uint32_t fragments(iovec *iov, uint32_t count) const;
+    size_t copyTo(void *buf, size_t len) const;
+    void release();
+
+private:
+    void take(KcpMessageView &other);
+
+    IQUEUEHEAD  mSegments;
+    size_t      mSize;
+    uint32_t    mCount;
+};
+
 class Kcp
 {
     friend class KcpManager;
+    friend class KcpListener;
 public:
     typedef std::shared_ptr<Kcp> SP;
     typedef std::function<void(eular::ByteBuffer &, sockaddr_in)> Callback;
+    typedef std::function<void(std::vector<eular::ByteBuffer> &, sockaddr_in)> BatchCallback;
+    typedef std::function<void(KcpMessageView &, sockaddr_in)> ViewCallback;
+    typedef std::function<void()> WritableCallback;
 
     Kcp();
     Kcp(const KcpAttr &attr);
     ~Kcp();
 
     bool installRecvEvent(Callback onRecvEvent);
-    void send(const eular::ByteBuffer &buffer);
+    bool installRecvBatchEvent(BatchCallback onRecvBatchEvent);
+    bool installRecvViewEvent(ViewCallback onRecvViewEvent);
+    bool installWritableEvent(WritableCallback onWritableEvent);
+    KcpSendResult send(const eular::ByteBuffer &buffer);
+    KcpSendResult send(eular::ByteBuffer &&buffer);
+    KcpSendResult sendv(const iovec *iov, int iovcnt);
     bool setAttr(const KcpAttr &attr);
     uint32_t check();
+    KcpStats getStats() const;
 
 private:
     bool init();
@@ -60,6 +169,33 @@ private:
     static int KcpOutput(const char *buf, int len, ikcpcb *kcp, void *user);
     void inputRoutine();
     void outputRoutine();
+    void movePending();
+    void flushOutput(bool immediate);
+    bool pacingEnabled() const;
+    void refillTokens();
+    bool paceAdmit(const char *buf, int32_t len);
+    void drainPaced();
+    uint32_t takePending(IQUEUEHEAD *segments);
+    void checkWritable();
+
+    typedef std::function<void(uint32_t, uint64_t)> UpdateHook;
+    void setUpdateHook(UpdateHook hook);
+    bool hasUpdateHook();
+    void markDirty(uint32_t delayMs);
+    bool beginUpdate(uint64_t due);
+    bool idle() const;
+    uint32_t nextUpdateDelay();
+    void recvMessage();
+    void recvMessageView();
+    void recvOnce();
+    void recvBatch();
+    void inputDatagram(const char *buf, int32_t len, const sockaddr_in &peerAddr, int32_t segSize);
+    void inputPacket(const char *buf, int32_t len, const sockaddr_in &peerAddr);
+    void inputFromRing(const char *buf, int32_t len, const sockaddr_in &peerAddr);
+    void sendBatch();
+    void sendGso();
+    static bool AttachJunkFilter(int fd, uint32_t convBase, uint32_t convCount);
+    static uint64_t SocketDrops(int fd);
 
     struct KcpCompare {
         bool operator() (const Kcp::SP &v1, const Kcp::SP &v2)
@@ -83,8 +219,45 @@ private:
     KcpAttr         mAttr;
 
     Callback        mRecvEvent;
-    eular::Mutex    mQueueMutex;
-    std::list<eular::ByteBuffer> mSendBufQueue;
+    BatchCallback   mRecvBatchEvent;
+    ViewCallback    mRecvViewEvent;
+    std::vector<eular::ByteBuffer> mRecvMessages;   // 一次读事件中取出的全部消息
+    // 已切分好的待发送消息, 首尾分片之间以node相连, 由outputRoutine移入snd_queue
+    struct PendingMessage {
+        IKCPSEG *first = nullptr;
+        IKCPSEG *last = nullptr;
+        uint32_t count = 0;
+    };
+    std::unique_ptr<KMpscQueue<PendingMessage>> mSendQueue;
+
+    // 发送背压: 排队分片数 = 队列中未移入snd_queue的分片 + 所属线程最近一次观察到的waitsnd
+    WritableCallback        mWritableEvent;
+    std::atomic<uint32_t>   mPendingSegments;
+    std::atomic<uint32_t>   mWaitSnd;
+    std::atomic<bool>       mWriteBlocked;
+
+    // 按ikcp_check调度: 只在有数据待发送/确认时安排一次outputRoutine, 空闲会话不占用定时器
+    eular::Mutex            mHookMutex;
+    UpdateHook              mUpdateHook;
+    std::atomic<uint64_t>   mUpdateDue;     // 已安排更新的到期时间(ms), 0表示未安排
+
+    // 节拍器: 令牌桶限制KcpOutput的发送速率, 超出的数据报暂存, 由更新定时器按速率释放. 仅所属线程访问
+    struct Pacer {
+        double      tokens = 0;     // bytes
+        uint64_t    lastUs = 0;
+        uint64_t    rate = 0;       // bytes/s
+        bool        draining = false;
+        std::deque<eular::ByteBuffer> queue;
+    };
+    Pacer                   mPacer;
+    std::atomic<uint64_t>   mPacedPackets;
+    std::atomic<uint64_t>   mPacingRate;
+
+    std::atomic<uint64_t> mRecvCalls;
+    std::atomic<uint64_t> mRecvPackets;
+    std::atomic<uint64_t> mSendCalls;
+    std::atomic<uint64_t> mSendPackets;
+    std::atomic<uint64_t> mJunkDrops;
 };
 
 #endif // __KCP_FIBER_H__
@@ -0,0 +1,265 @@
+/*************************************************************************
+    > File Name: kcplistener.cpp
+    > Author: hsz
+    > Brief:
+    > Created Time: Sat 17 Oct 2026 05:12:45 PM CST
+ ************************************************************************/
+
+#include "kcplistener.h"
+#include <utils/utils.h>
+#include <utils/exception.h>
+#include <log/log.h>
+
+#define LOG_TAG "KcpListener"
+
+#define LISTENER_SLOT_SIZE  2048    // 单个数据报接收槽大小, 需大于会话mtu
+#define KCP_HEAD_SIZE       24      // IKCP_OVERHEAD
+#define KCP_CMD_PUSH        81      // IKCP_CMD_PUSH
+
+KcpListener::KcpListener(const KcpListenerAttr &attr) :
+    mAttr(attr),
+    mBindTid(0),
+    mPinTid(0),
+    mAcceptEvent(nullptr),
+    mCloseEvent(nullptr),
+    mSessionHook(nullptr),
+    mRecvCalls(0),
+    mRecvPackets(0),
+    mJunkDrops(0)
+{
+    if (mAttr.fd < 0 || mAttr.maxSessions == 0) {
+        throw eular::Exception("KcpListener(const KcpListenerAttr &attr) invalid attr.");
+    }
+    if (mAttr.recvBatch == 0) {
+        mAttr.recvBatch = 1;
+    }
+}
+
+KcpListener::~KcpListener()
+{
+    {
+        eular::AutoLock<eular::Mutex> lock(mSessionMutex);
+        for (const auto &it : mSessionMap) {
+            it.second->setUpdateHook(nullptr);
+        }
+        mSessionMap.clear();
+    }
+    if (mAttr.autoClose) {
+        close(mAttr.fd);
+    }
+}
+
+void KcpListener::installAcceptEvent(SessionCallback onAcceptEvent)
+{
+    mAcceptEvent.swap(onAcceptEvent);
+}
+
+void KcpListener::installCloseEvent(SessionCallback onCloseEvent)
+{
+    mCloseEvent.swap(onCloseEvent);
+}
+
+Kcp::SP KcpListener::getSession(uint32_t conv)
+{
+    eular::AutoLock<eular::Mutex> lock(mSessionMutex);
+    auto it = mSessionMap.find(conv);
+    if (it != mSessionMap.end()) {
+        return it->second;
+    }
+    return nullptr;
+}
+
+bool KcpListener::closeSession(uint32_t conv)
+{
+    eular::AutoLock<eular::Mutex> lock(mSessionMutex);
+    auto it = mSessionMap.find(conv);
+    if (it == mSessionMap.end()) {
+        return false;
+    }
+    it->second->setUpdateHook(nullptr);
+    mSessionMap.erase(it);
+    return true;
+}
+
+size_t KcpListener::sessionCount()
+{
+    eular::AutoLock<eular::Mutex> lock(mSessionMutex);
+    return mSessionMap.size();
+}
+
+KcpStats KcpListener::getStats() const
+{
+    KcpStats stats;
+    stats.recvCalls = mRecvCalls.load(std::memory_order_relaxed);
+    stats.recvPackets = mRecvPackets.load(std::memory_order_relaxed);
+    stats.junkDrops = mJunkDrops.load(std::memory_order_relaxed);
+    stats.socketDrops = Kcp::SocketDrops(mAttr.fd);
+    return stats;
+}
+
+bool KcpListener::create()
+{
+    mBindTid = gettid();
+
+    uint32_t batch = mAttr.recvBatch;
+    mMsgs.resize(batch);
+    mIovs.resize(batch);
+    mAddrs.resize(batch);
+    mBuffer.resize(batch * LISTENER_SLOT_SIZE);
+    return true;
+}
+
+/**
+ * @brief 使用recvmmsg批量读取数据报直到读空socket, 并按conv分发给会话
+ */
+void KcpListener::inputRoutine()
+{
+    uint32_t batch = mAttr.recvBatch;
+
+    while (true) {
+        // recvmmsg会改写msg_namelen, 每次调用前需重置
+        for (uint32_t i = 0; i < batch; ++i) {
+            mIovs[i].iov_base = &mBuffer[i * LISTENER_SLOT_SIZE];
+            mIovs[i].iov_len = LISTENER_SLOT_SIZE;
+            memset(&mMsgs[i], 0, sizeof(mmsghdr));
+            mMsgs[i].msg_hdr.msg_name = &mAddrs[i];
+            mMsgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            mMsgs[i].msg_hdr.msg_iov = &mIovs[i];
+            mMsgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int32_t nmsgs = ::recvmmsg(mAttr.fd, mMsgs.data(), batch, 0, nullptr);
+        if (nmsgs < 0) {
+            if (errno != EAGAIN) {
+                LOGE("recvmmsg error. [%d,%s]", errno, strerror(errno));
+            }
+
+            break;
+        }
+        mRecvCalls.fetch_add(1, std::memory_order_relaxed);
+        mRecvPackets.fetch_add(nmsgs, std::memory_order_relaxed);
+
+        for (int32_t i = 0; i < nmsgs; ++i) {
+            const mmsghdr &msg = mMsgs[i];
+            if (msg.msg_hdr.msg_flags & MSG_TRUNC) {
+                LOGE("datagram truncated, larger than %d", LISTENER_SLOT_SIZE);
+                continue;
+            }
+            dispatch((const char *)mIovs[i].iov_base, msg.msg_len, mAddrs[i]);
+        }
+        flushTouched();
+
+        if (static_cast<uint32_t>(nmsgs) < batch) {  // 已读空
+            break;
+        }
+    }
+}
+
+/**
+ * @brief 回收失连(dead link)的会话. 会话的ikcp_update由各自的更新钩子按ikcp_check安排, 此处不再逐个驱动
+ */
+void KcpListener::outputRoutine()
+{
+    std::vector<Kcp::SP> deadSessions;
+    {
+        eular::AutoLock<eular::Mutex> lock(mSessionMutex);
+        for (auto it = mSessionMap.begin(); it != mSessionMap.end(); ) {
+            if (it->second->mKcpHandle->state != (IUINT32)-1) {
+                ++it;
+                continue;
+            }
+            LOGW("session(%u) dead link", it->first);
+            it->second->setUpdateHook(nullptr);
+            deadSessions.push_back(it->second);
+            it = mSessionMap.erase(it);
+        }
+    }
+
+    if (mCloseEvent) {
+        for (const auto &session : deadSessions) {
+            mCloseEvent(session);
+        }
+    }
+}
+
+void KcpListener::inputFromRing(const char *buf, int32_t len, const sockaddr_in &peerAddr)
+{
+    mRecvCalls.fetch_add(1, std::memory_order_relaxed);
+    mRecvPackets.fetch_add(1, std::memory_order_relaxed);
+    dispatch(buf, len, peerAddr);
+    flushTouched();
+}
+
+/**
+ * @brief 低延迟模式下, 本批输入涉及的会话立即flush, 使ACK不必等到下一次定时更新
+ */
+void KcpListener::flushTouched()
+{
+    for (const auto &session : mTouched) {
+        session->flushOutput(true);
+    }
+    mTouched.clear();
+}
+
+void KcpListener::dispatch(const char *buf, int32_t len, const sockaddr_in &peerAddr)
+{
+    if (len < KCP_HEAD_SIZE) {
+        mJunkDrops.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint32_t conv = ikcp_getconv(buf);
+    Kcp::SP session = getSession(conv);
+    if (session == nullptr) {
+        // 只有落在会话号范围内的数据段才会创建会话
+        if (conv - mAttr.convBase >= mAttr.maxSessions ||
+            static_cast<uint8_t>(buf[4]) != KCP_CMD_PUSH) {
+            LOGD("drop datagram of conv(%u) from [%s:%d]", conv, inet_ntoa(peerAddr.sin_addr), ntohs(peerAddr.sin_port));
+            mJunkDrops.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        session = acceptSession(conv, peerAddr);
+        if (session == nullptr) {
+            return;
+        }
+    }
+
+    session->inputPacket(buf, len, peerAddr);
+    session->recvMessage();
+    session->checkWritable();
+    if (session->mAttr.lowLatency && (mTouched.empty() || mTouched.back() != session)) {
+        mTouched.push_back(session);
+    }
+}
+
+Kcp::SP KcpListener::acceptSession(uint32_t conv, const sockaddr_in &peerAddr)
+{
+    KcpAttr attr = mAttr.session;
+    attr.fd = mAttr.fd;
+    attr.autoClose = 0;
+    attr.conv = conv;
+    attr.addr = peerAddr;
+    attr.udpGro = 0;
+
+    Kcp::SP session(new (std::nothrow) Kcp());
+    if (session == nullptr || !session->setAttr(attr)) {
+        LOGE("create session(%u) error", conv);
+        return nullptr;
+    }
+    session->create();
+    if (mSessionHook) {
+        mSessionHook(session);
+    }
+
+    {
+        eular::AutoLock<eular::Mutex> lock(mSessionMutex);
+        mSessionMap[conv] = session;
+    }
+    LOGI("accept session(%u) from [%s:%d]", conv, inet_ntoa(peerAddr.sin_addr), ntohs(peerAddr.sin_port));
+
+    if (mAcceptEvent) {
+        mAcceptEvent(session);
+    }
+    return session;
+}
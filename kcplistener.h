@@ -0,0 +1,88 @@
+/*************************************************************************
+    > File Name: kcplistener.h
+    > Author: hsz
+    > Brief:
+    > Created Time: Sat 17 Oct 2026 05:12:40 PM CST
+ ************************************************************************/
+
+#ifndef __KCP_LISTENER_H__
+#define __KCP_LISTENER_H__
+
+#include "kcp.h"
+#include <sys/socket.h>
+#include <unordered_map>
+#include <vector>
+
+#define KCP_LISTENER_CONV_BASE  0x4B435000
+#define KCP_LISTENER_REAP_INTERVAL  1000  // ms, 回收失连会话的周期
+
+struct KcpListenerAttr
+{
+    int32_t  fd;            // listening socket, shared by all sessions
+    uint8_t  autoClose;     // whether to close automatically
+    uint32_t convBase;      // first conv accepted, default is 0x4B435000
+    uint32_t maxSessions;   // accepted conv range is [convBase, convBase + maxSessions)
+    uint16_t recvBatch;     // datagrams per recvmmsg call
+    uint8_t  junkFilter;    // 0:disable(default), 1:drop datagrams outside the conv range in kernel
+    KcpAttr  session;       // template of session attributes, fd/autoClose/conv/addr are ignored
+
+    KcpListenerAttr() :
+        fd(-1), autoClose(0),
+        convBase(KCP_LISTENER_CONV_BASE), maxSessions(256),
+        recvBatch(32), junkFilter(0)
+    {
+    }
+};
+
+/**
+ * @brief 一个udp套接字承载多个kcp会话, 按conv分发数据报, 收到未知conv的数据时按需创建会话
+ */
+class KcpListener
+{
+    friend class KcpManager;
+public:
+    typedef std::shared_ptr<KcpListener> SP;
+    typedef std::function<void(Kcp::SP)> SessionCallback;
+
+    KcpListener(const KcpListenerAttr &attr);
+    ~KcpListener();
+
+    void installAcceptEvent(SessionCallback onAcceptEvent);
+    void installCloseEvent(SessionCallback onCloseEvent);
+    Kcp::SP getSession(uint32_t conv);
+    bool closeSession(uint32_t conv);
+    size_t sessionCount();
+    KcpStats getStats() const;
+
+private:
+    bool create();
+    void inputRoutine();
+    void outputRoutine();
+    void inputFromRing(const char *buf, int32_t len, const sockaddr_in &peerAddr);
+    void dispatch(const char *buf, int32_t len, const sockaddr_in &peerAddr);
+    void flushTouched();
+    Kcp::SP acceptSession(uint32_t conv, const sockaddr_in &peerAddr);
+
+private:
+    KcpListenerAttr mAttr;
+    uint32_t        mBindTid;
+    uint32_t        mPinTid;        // 非0时只能由该线程注册与驱动(SO_REUSEPORT分片)
+
+    SessionCallback mAcceptEvent;
+    SessionCallback mCloseEvent;
+    std::function<void(const Kcp::SP &)> mSessionHook;  // 由KcpManager设置, 为接受的会话安装更新钩子
+    eular::Mutex    mSessionMutex;
+    std::unordered_map<uint32_t, Kcp::SP> mSessionMap;
+
+    std::vector<mmsghdr>        mMsgs;
+    std::vector<iovec>          mIovs;
+    std::vector<sockaddr_in>    mAddrs;
+    std::vector<char>           mBuffer;
+    std::vector<Kcp::SP>        mTouched;   // 低延迟模式下本批输入涉及的会话
+
+    std::atomic<uint64_t> mRecvCalls;
+    std::atomic<uint64_t> mRecvPackets;
+    std::atomic<uint64_t> mJunkDrops;
+};
+
+#endif // __KCP_LISTENER_H__
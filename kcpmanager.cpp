@@ -10,9 +10,11 @@
 #include <log/log.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <linux/filter.h>
 #include <errno.h>
 #include <string.h>
 #include <functional>
+#include <memory>
 
 #define LOG_TAG "KcpManager"
 
@@ -20,10 +22,57 @@ using namespace eular;
 
 static uint32_t epoll_event_size = 1024;
 
-KcpManager::KcpManager(uint8_t threads, bool userCaller, const String8 &name) :
+#define URING_ENTRIES       256
+#define URING_BUF_COUNT     1024    // 须为2的幂
+#define URING_BUF_SIZE      4096    // io_uring_recvmsg_out + sockaddr_in + 数据报
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+/**
+ * @brief 为SO_REUSEPORT组挂载经典BPF程序, 按kcp头部conv选择套接字:
+ *        index = (conv - convBase) % shards, 与createShardedListeners中分片到线程的映射一致.
+ *        reuseport程序运行时数据起始于UDP负载, conv为小端序, 需逐字节装载
+ */
+static bool attachConvSteering(int fd, uint32_t convBase, uint32_t shards)
+{
+    sock_filter code[] = {
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 3),       // A = payload[3]
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K,   8),
+        BPF_STMT(BPF_MISC| BPF_TAX,           0),       // X = A
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 2),
+        BPF_STMT(BPF_ALU | BPF_OR  | BPF_X,   0),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K,   8),
+        BPF_STMT(BPF_MISC| BPF_TAX,           0),
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 1),
+        BPF_STMT(BPF_ALU | BPF_OR  | BPF_X,   0),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K,   8),
+        BPF_STMT(BPF_MISC| BPF_TAX,           0),
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 0),
+        BPF_STMT(BPF_ALU | BPF_OR  | BPF_X,   0),       // A = conv
+        BPF_STMT(BPF_ALU | BPF_SUB | BPF_K,   convBase),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K,   shards),
+        BPF_STMT(BPF_RET | BPF_A,             0),
+    };
+    sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+        LOGW("setsockopt(%d, SO_ATTACH_REUSEPORT_CBPF) error. [%d, %s]", fd, errno, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+KcpManager::KcpManager(uint8_t threads, bool userCaller, const String8 &name, bool multiReactor,
+                       IoEngine engine) :
     KScheduler(threads, userCaller, name),
     mEventCount(0),
-    mEventFd(-1)
+    mEventFd(-1),
+    mEngine(engine),
+    mMultiReactor(multiReactor || engine == IoEngine::IO_URING)
 {
     mEpollFd = epoll_create(epoll_event_size);
     if (mEpollFd < 0) {
@@ -87,6 +136,78 @@ bool KcpManager::delKcp(Kcp::SP kcp)
     return true;
 }
 
+bool KcpManager::addListener(KcpListener::SP listener)
+{
+    if (mEventCount >= epoll_event_size) {
+        LOGW("events are full");
+        return false;
+    }
+    AutoLock<Mutex> lock(mQueueMutex);
+    if (listener == nullptr) {
+        return false;
+    }
+    auto it = mListenerQueue.insert(std::make_pair(listener, KcpState::NOTINIT));
+    return it.second;
+}
+
+bool KcpManager::delListener(KcpListener::SP listener)
+{
+    AutoLock<Mutex> lock(mQueueMutex);
+    auto it = mListenerQueue.find(listener);
+    if (it != mListenerQueue.end()) {
+        it->second = KcpState::REMOVE;
+    }
+    return true;
+}
+
+/**
+ * @brief 在同一地址上为每个调度线程创建一个SO_REUSEPORT套接字及listener, 由内核按四元组分散流量.
+ *        convSteering为true时改为按conv选择分片, 使同一会话的数据总落在持有其ikcpcb的线程.
+ *        返回的listener已固定到各自线程, 安装回调后调用addListener注册
+ */
+std::vector<KcpListener::SP> KcpManager::createShardedListeners(const sockaddr_in &addr, const KcpListenerAttr &attr,
+                                                                bool convSteering)
+{
+    std::vector<KcpListener::SP> shards;
+    for (size_t i = 0; i < mThreadIds.size(); ++i) {
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) {
+            LOGE("socket error. [%d, %s]", errno, strerror(errno));
+            break;
+        }
+
+        int reuse = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0 ||
+            bind(fd, (const sockaddr *)&addr, sizeof(sockaddr_in)) < 0) {
+            LOGE("SO_REUSEPORT bind [%s:%d] error. [%d, %s]", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port), errno, strerror(errno));
+            close(fd);
+            break;
+        }
+
+        KcpListenerAttr shardAttr = attr;
+        shardAttr.fd = fd;
+        shardAttr.autoClose = 1;
+        KcpListener::SP listener(new (std::nothrow) KcpListener(shardAttr));
+        if (listener == nullptr) {
+            close(fd);
+            break;
+        }
+        listener->mPinTid = mThreadIds[i];
+        shards.push_back(listener);
+    }
+
+    if (shards.size() != mThreadIds.size()) {
+        shards.clear();
+        return shards;
+    }
+
+    // 套接字在reuseport组内的序号即bind顺序, 挂载到任一成员即对整组生效
+    if (convSteering && !shards.empty()) {
+        attachConvSteering(shards[0]->mAttr.fd, attr.convBase, shards.size());
+    }
+    return shards;
+}
+
 KcpManager *KcpManager::GetThis()
 {
     return static_cast<KcpManager *>(KScheduler::GetThis());
@@ -102,6 +223,40 @@ void KcpManager::idle()
         }
     });
 
+    epoll_event *sharedEvents = new epoll_event[maxEvents]();
+    std::shared_ptr<epoll_event> sharedPtr(sharedEvents, [](epoll_event *p) {
+        if (p) {
+            delete[] p;
+        }
+    });
+
+    // 线程私有epoll仅在多reactor或有固定到本线程的listener时创建, 否则所有线程直接等待共享的mEpollFd,
+    // 避免每个线程都嵌套监听mEpollFd(水平触发)时一次就绪唤醒全部线程
+    int localEpollFd = mMultiReactor ? createLocalEpoll() : -1;
+
+    Reactor *reactor = nullptr;
+    if (mMultiReactor && localEpollFd >= 0) {
+        AutoLock<Mutex> lock(mReactorMutex);
+        reactor = &mReactors[gettid()];
+        reactor->epollFd = localEpollFd;
+        reactor->eventFd = eventfd(0, EFD_NONBLOCK);
+
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = reactor;
+        if (reactor->eventFd < 0 || epoll_ctl(localEpollFd, EPOLL_CTL_ADD, reactor->eventFd, &ev) < 0) {
+            LOGE("reactor eventfd error. [%d, %s]", errno, strerror(errno));
+        }
+    }
+    int sessionEpollFd = reactor ? localEpollFd : mEpollFd;
+
+    std::unique_ptr<KUring> uring;
+    if (reactor && mEngine == IoEngine::IO_URING) {
+        uring.reset(createUring(localEpollFd));
+    }
+    bool pollPending = false;
+
     uint32_t localEventCount = 0;
     uint32_t tid = gettid();
     uint64_t timeoutms = 10;
@@ -123,39 +278,26 @@ void KcpManager::idle()
                         int fd = it->first->mAttr.fd;
                         int flag = fcntl(fd, F_GETFL);
                         fcntl(fd, F_SETFL, flag | O_NONBLOCK);
-
-                        Context *ctx = nullptr;
-                        {
-                            AutoLock<Mutex> lock(mCtxMutex);
-                            if (fd >= mContextVec.size()) {
-                                contextResize(fd * 1.5);
+                        if (it->first->mAttr.udpGro) {
+                            int on = 1;
+                            if (setsockopt(fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) < 0) {
+                                LOGW("setsockopt(%d, UDP_GRO) error. [%d, %s]", fd, errno, strerror(errno));
+                                it->first->mAttr.udpGro = 0;
                             }
-                            ctx = mContextVec[fd];
+                        }
+                        if (it->first->mAttr.junkFilter) {
+                            Kcp::AttachJunkFilter(fd, it->first->mAttr.conv, 1);
                         }
 
-                        LOG_ASSERT2(ctx != nullptr);
-                        ctx->events = READ;
-                        ctx->fd = fd;
-                        ctx->tid = tid;
-                        ctx->read.cb = std::bind(&Kcp::inputRoutine, it->first.get());
-                        ctx->read.fiber = nullptr;
-                        ctx->read.scheduler = KScheduler::GetThis();
-                        auto timer = addTimer(it->first->mAttr.interval,
-                            std::bind(&Kcp::outputRoutine, it->first.get()),
-                            it->first->mAttr.interval, tid);
-                        LOG_ASSERT2(timer != nullptr);
-                        ctx->timerId = timer->getUniqueId();
-                        LOGD("addTimer() timer id: %lu, interval: %d", timer->getUniqueId(), it->first->mAttr.interval);
-                        epoll_event ev;
-                        ev.data.ptr = ctx;
-                        ev.events = EPOLLET | EPOLLIN;
-
-                        int ret = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev);
-                        if (ret < 0) {
-                            LOGE("epoll_ctl(%d, EPOLL_CTL_ADD , %d) error. [%d, %s]", mEpollFd, fd, errno, strerror(errno));
-                            ctx->resetContext(READ);
-                            timer->cancel();
-                        } else {
+                        // 不再使用固定周期定时器, 首次立即更新, 之后由ikcp_check安排, 空闲时不占用定时器
+                        Kcp *kcp = it->first.get();
+                        std::weak_ptr<Kcp> weak = it->first;
+                        installUpdateHook(it->first, tid);
+                        if (registerEvent(sessionEpollFd, fd, std::bind(&Kcp::inputRoutine, kcp),
+                                std::bind(&KcpManager::onKcpUpdate, this, weak, 0), 0, 0, tid,
+                                [kcp] (const char *buf, int32_t len, const sockaddr_in &addr) {
+                                    kcp->inputFromRing(buf, len, addr);
+                                })) {
                             ++mEventCount;
                             ++localEventCount;
                         }
@@ -168,15 +310,9 @@ void KcpManager::idle()
                     }
                     case KcpState::REMOVE:
                     {
+                        it->first->setUpdateHook(nullptr);
                         if (it->first->mBindTid == gettid()) {
-                            uint64_t timerId = 0;
-                            epoll_ctl(mEpollFd, EPOLL_CTL_DEL, it->first->mAttr.fd, nullptr);
-                            {
-                                AutoLock<Mutex> lock(mCtxMutex);
-                                timerId = mContextVec[it->first->mAttr.fd]->timerId;
-                                mContextVec[it->first->mAttr.fd]->resetContext(READ);
-                            }
-                            delTimer(timerId);
+                            unregisterEvent(it->first->mAttr.fd);
                             --mEventCount;
                             --localEventCount;
                         }
@@ -190,6 +326,7 @@ void KcpManager::idle()
 
                     ++it;
                 }
+                processListenerQueue(tid, localEpollFd, sessionEpollFd, localEventCount);
             }
         }
 
@@ -198,50 +335,352 @@ void KcpManager::idle()
         }
 
         int nev = 0;
-        do {
-            nev = epoll_wait(mEpollFd, events, maxEvents, timeoutms);
-            if (nev < 0 && errno == EINTR) {
-                KFiber::Yeild2Hold();
-            } else {
+        if (uring) {
+            // 提交排队的发送并等待完成事件, 接收的数据报在wait内回调到所属会话;
+            // 线程epoll(含共享epoll与eventfd)就绪时再以非阻塞方式取出
+            bool pollReady = false;
+            if (uring->wait(pollPending ? 0 : timeoutms, pollReady) < 0) {
                 break;
             }
-        } while (true);
+            if (pollReady || pollPending) {
+                nev = epoll_wait(localEpollFd, events, maxEvents, 0);
+                if (nev < 0 && errno != EINTR) {
+                    LOGE("epoll_wait error. [%d, %s]", errno, strerror(errno));
+                    break;
+                }
+                nev = nev < 0 ? 0 : nev;
+                pollPending = (static_cast<uint32_t>(nev) == maxEvents);
+            }
+        } else {
+            do {
+                nev = epoll_wait(localEpollFd >= 0 ? localEpollFd : mEpollFd, events, maxEvents, timeoutms);
+                if (nev < 0 && errno == EINTR) {
+                    KFiber::Yeild2Hold();
+                } else {
+                    break;
+                }
+            } while (true);
 
-        if (nev < 0) {
-            LOGE("epoll_wait error. [%d, %s]", errno, strerror(errno));
-            break;
+            if (nev < 0) {
+                LOGE("epoll_wait error. [%d, %s]", errno, strerror(errno));
+                break;
+            }
         }
 
         // 回调 -- tid
         std::list<std::pair<std::function<void()>, uint32_t>> cbs;
         listExpiredTimer(cbs);
+        if (reactor) {  // 本线程的定时器直接执行, 其余交给所属线程
+            for (auto it = cbs.begin(); it != cbs.end(); ) {
+                if (it->second == tid) {
+                    it->first();
+                    it = cbs.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
         schedule(cbs.begin(), cbs.end());
 
         for (int i = 0; i < nev; ++i) {
-            epoll_event &ev = events[i];
-            if (ev.data.fd == mEventFd) {
+            if (events[i].data.ptr == nullptr) {    // 共享epoll有事件就绪
+                int nshared = epoll_wait(mEpollFd, sharedEvents, maxEvents, 0);
+                if (nshared > 0) {
+                    processEvents(sharedEvents, nshared, tid);
+                }
+                continue;
+            }
+            if (reactor && events[i].data.ptr == reactor) {
                 eventfd_t value;
-                eventfd_read(mEventFd, &value);
+                eventfd_read(reactor->eventFd, &value);
                 continue;
             }
+            processEvents(&events[i], 1, tid);
+        }
+
+        KFiber::Yeild2Hold();
+    }
+
+    uring.reset();
+    if (reactor) {
+        AutoLock<Mutex> lock(mReactorMutex);
+        if (reactor->eventFd >= 0) {
+            close(reactor->eventFd);
+        }
+        mReactors.erase(tid);
+    }
+    if (localEpollFd >= 0) {
+        close(localEpollFd);
+    }
+}
+
+/**
+ * @brief 会话的更新由markDirty按需安排到tid线程的一次性定时器, addKcp的会话与listener接受的会话共用
+ */
+void KcpManager::installUpdateHook(const Kcp::SP &kcp, uint32_t tid)
+{
+    std::weak_ptr<Kcp> weak = kcp;
+    kcp->setUpdateHook([this, weak, tid] (uint32_t delayMs, uint64_t due) {
+        addTimer(delayMs, std::bind(&KcpManager::onKcpUpdate, this, weak, due), 0, tid);
+    });
+}
+
+/**
+ * @brief 会话更新定时器: 执行outputRoutine后按ikcp_check安排下一次, 空闲则不再安排, 直到send/input将其标记为脏.
+ *        due为安排时的到期时间, 已被更早的安排取代的定时器直接返回; 注册时的首次更新due为0
+ */
+void KcpManager::onKcpUpdate(std::weak_ptr<Kcp> weak, uint64_t due)
+{
+    Kcp::SP kcp = weak.lock();
+    if (kcp == nullptr || !kcp->hasUpdateHook()) {  // 已delKcp
+        return;
+    }
+    if (!kcp->beginUpdate(due)) {
+        return;
+    }
+
+    kcp->outputRoutine();
+    uint32_t delay = kcp->nextUpdateDelay();
+    if (delay != UINT32_MAX) {
+        kcp->markDirty(delay);
+    }
+}
+
+void KcpManager::processEvents(epoll_event *events, int nev, uint32_t tid)
+{
+    for (int i = 0; i < nev; ++i) {
+        epoll_event &ev = events[i];
+        if (ev.data.fd == mEventFd) {
+            eventfd_t value;
+            eventfd_read(mEventFd, &value);
+            continue;
+        }
+
+        Context *ctx = static_cast<Context *>(ev.data.ptr);
+        LOG_ASSERT2(ctx != nullptr);
+        if (mMultiReactor && ctx->tid == tid) {   // 会话属于本线程, 直接执行
+            std::function<void()> cb;
+            {
+                AutoLock<Mutex> lock(ctx->mutex);
+                cb = ctx->read.cb;
+            }
+            if (cb) {
+                cb();
+            }
+            continue;
+        }
+
+        AutoLock<Mutex> lock(ctx->mutex);
+        if (ev.events & (EPOLLERR | EPOLLHUP)) {
+            ev.events |= (EPOLLIN | EPOLLOUT) & ctx->events;
+        }
 
-            Context *ctx = static_cast<Context *>(ev.data.ptr);
-            LOG_ASSERT2(ctx != nullptr);
-            AutoLock<Mutex> lock(ctx->mutex);
-            if (ev.events & (EPOLLERR | EPOLLHUP)) {
-                ev.events |= (EPOLLIN | EPOLLOUT) & ctx->events;
+        if (ev.events | EPOLLIN) {
+            ctx->triggerEvent(READ);
+        }
+        if (ev.events | EPOLLOUT) {
+            ctx->triggerEvent(WRITE);
+        }
+    }
+}
+
+/**
+ * @brief 创建线程私有epoll, 共享的mEpollFd作为其中一项(data.ptr为nullptr), 失败返回-1
+ */
+int KcpManager::createLocalEpoll()
+{
+    int localEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (localEpollFd < 0) {
+        LOGE("epoll_create1 error. [%d, %s]", errno, strerror(errno));
+        return -1;
+    }
+
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    if (epoll_ctl(localEpollFd, EPOLL_CTL_ADD, mEpollFd, &ev) < 0) {
+        LOGE("epoll_ctl(%d, EPOLL_CTL_ADD , %d) error. [%d, %s]", localEpollFd, mEpollFd, errno, strerror(errno));
+        close(localEpollFd);
+        return -1;
+    }
+    return localEpollFd;
+}
+
+/**
+ * @brief 为当前线程创建io_uring, 以多发poll监听线程epoll. 内核不支持时返回nullptr, 该线程继续使用epoll
+ */
+KUring *KcpManager::createUring(int localEpollFd)
+{
+    KUring *uring = new (std::nothrow) KUring();
+    if (uring == nullptr || !uring->init(URING_ENTRIES, URING_BUF_COUNT, URING_BUF_SIZE) ||
+        !uring->pollAdd(localEpollFd)) {
+        LOGW("io_uring unavailable on thread %d, fall back to epoll", gettid());
+        delete uring;
+        return nullptr;
+    }
+
+    uring->setDatagramCallback([] (void *owner, const char *buf, int32_t len, const sockaddr_in &addr) {
+        Context *ctx = static_cast<Context *>(owner);
+        if (ctx->datagram) {
+            ctx->datagram(buf, len, addr);
+        }
+    });
+    // 套接字不支持多发recvmsg时改为注册到线程epoll
+    uring->setErrorCallback([] (void *owner, int err) {
+        Context *ctx = static_cast<Context *>(owner);
+        LOGW("fd %d multishot recvmsg unsupported. [%d, %s], fall back to epoll", ctx->fd, err, strerror(err));
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.data.ptr = ctx;
+        ev.events = EPOLLET | EPOLLIN;
+        ctx->uring = false;
+        if (epoll_ctl(ctx->epollFd, EPOLL_CTL_ADD, ctx->fd, &ev) < 0) {
+            LOGE("epoll_ctl(%d, EPOLL_CTL_ADD , %d) error. [%d, %s]", ctx->epollFd, ctx->fd, errno, strerror(errno));
+            return;
+        }
+        if (ctx->read.cb) {
+            ctx->read.cb();
+        }
+    });
+    return uring;
+}
+
+/**
+ * @brief 将等待队列中的listener加入epoll, 调用者需持有mQueueMutex.
+ *        固定到本线程的listener首次出现时才创建线程私有epoll
+ */
+void KcpManager::processListenerQueue(uint32_t tid, int &localEpollFd, int sessionEpollFd, uint32_t &localEventCount)
+{
+    for (auto it = mListenerQueue.begin(); it != mListenerQueue.end(); ) {
+        KcpListener::SP listener = it->first;
+        bool pinned = listener->mPinTid != 0;
+        if (pinned && listener->mPinTid != tid) {  // 只能由其固定的线程处理
+            ++it;
+            continue;
+        }
+
+        if (it->second == KcpState::NOTINIT) {
+            if (mEventCount >= epoll_event_size) {
+                break;
             }
+            listener->create();
 
-            if (ev.events | EPOLLIN) {
-                ctx->triggerEvent(READ);
+            int fd = listener->mAttr.fd;
+            int flag = fcntl(fd, F_GETFL);
+            fcntl(fd, F_SETFL, flag | O_NONBLOCK);
+            if (listener->mAttr.junkFilter) {
+                Kcp::AttachJunkFilter(fd, listener->mAttr.convBase, listener->mAttr.maxSessions);
+            }
+
+            if (pinned && localEpollFd < 0) {
+                localEpollFd = createLocalEpoll();
+            }
+            // 会话与addKcp的会话一样由ikcp_check按需更新, listener的慢速定时器只回收失连会话
+            int epollFd = (pinned && localEpollFd >= 0) ? localEpollFd : sessionEpollFd;
+            KcpListener *ptr = listener.get();
+            listener->mSessionHook = [this, tid] (const Kcp::SP &session) {
+                installUpdateHook(session, tid);
+            };
+            if (registerEvent(epollFd, fd, std::bind(&KcpListener::inputRoutine, ptr),
+                    std::bind(&KcpListener::outputRoutine, ptr), KCP_LISTENER_REAP_INTERVAL,
+                    KCP_LISTENER_REAP_INTERVAL, tid,
+                    [ptr] (const char *buf, int32_t len, const sockaddr_in &addr) {
+                        ptr->inputFromRing(buf, len, addr);
+                    })) {
+                ++mEventCount;
+                ++localEventCount;
+                it->second = KcpState::INITED;
+            } else {
+                it = mListenerQueue.erase(it);
+                continue;
             }
-            if (ev.events | EPOLLOUT) {
-                ctx->triggerEvent(WRITE);
+        } else if (it->second == KcpState::REMOVE) {
+            if (listener->mBindTid == 0) {  // 未加入epoll
+                it = mListenerQueue.erase(it);
+                continue;
+            }
+            if (listener->mBindTid == tid) {
+                unregisterEvent(listener->mAttr.fd);
+                --mEventCount;
+                --localEventCount;
+                it = mListenerQueue.erase(it);
+                continue;
             }
         }
+        ++it;
+    }
+}
+
+bool KcpManager::registerEvent(int epollFd, int fd, std::function<void()> readCb,
+                               std::function<void()> timerCb, int32_t interval, uint32_t recycle, uint32_t tid,
+                               Context::DatagramCallback datagramCb)
+{
+    Context *ctx = nullptr;
+    {
+        AutoLock<Mutex> lock(mCtxMutex);
+        if (fd >= mContextVec.size()) {
+            contextResize(fd * 1.5);
+        }
+        ctx = mContextVec[fd];
+    }
 
-        KFiber::Yeild2Hold();
+    LOG_ASSERT2(ctx != nullptr);
+    ctx->events = READ;
+    ctx->fd = fd;
+    ctx->epollFd = epollFd;
+    ctx->tid = tid;
+    ctx->read.cb = readCb;
+    ctx->read.fiber = nullptr;
+    ctx->read.scheduler = KScheduler::GetThis();
+    auto timer = addTimer(interval, timerCb, recycle, tid);
+    LOG_ASSERT2(timer != nullptr);
+    ctx->timerId = timer->getUniqueId();
+    LOGD("addTimer() timer id: %lu, interval: %d", timer->getUniqueId(), interval);
+
+    // 本线程有io_uring时, 线程私有的fd改由多发recvmsg接收
+    KUring *uring = KUring::Current();
+    if (uring != nullptr && datagramCb && epollFd != mEpollFd) {
+        ctx->datagram = datagramCb;
+        if (uring->armRecv(fd, ctx)) {
+            ctx->uring = true;
+            return true;
+        }
+        ctx->datagram = nullptr;
+    }
+
+    epoll_event ev;
+    ev.data.ptr = ctx;
+    ev.events = EPOLLET | EPOLLIN;
+
+    int ret = epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    if (ret < 0) {
+        LOGE("epoll_ctl(%d, EPOLL_CTL_ADD , %d) error. [%d, %s]", epollFd, fd, errno, strerror(errno));
+        ctx->resetContext(READ);
+        timer->cancel();
+        return false;
+    }
+    return true;
+}
+
+void KcpManager::unregisterEvent(int fd)
+{
+    uint64_t timerId = 0;
+    {
+        AutoLock<Mutex> lock(mCtxMutex);
+        Context *ctx = mContextVec[fd];
+        if (ctx->uring) {
+            KUring *uring = KUring::Current();
+            if (uring != nullptr) {
+                uring->cancelRecv(ctx);
+            }
+        } else {
+            epoll_ctl(ctx->epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        }
+        timerId = mContextVec[fd]->timerId;
+        mContextVec[fd]->resetContext(READ);
     }
+    delTimer(timerId);
 }
 
 void KcpManager::tickle()
@@ -252,6 +691,19 @@ void KcpManager::tickle()
     eventfd_write(mEventFd, 1);
 }
 
+void KcpManager::tickle(int th)
+{
+    if (mMultiReactor && th != 0) {
+        AutoLock<Mutex> lock(mReactorMutex);
+        auto it = mReactors.find(th);
+        if (it != mReactors.end() && it->second.eventFd >= 0) {
+            eventfd_write(it->second.eventFd, 1);
+            return;
+        }
+    }
+    tickle();
+}
+
 bool KcpManager::stopping(uint64_t &timeout)
 {
     timeout = getNearTimeout();
@@ -306,6 +758,8 @@ void KcpManager::Context::resetContext(uint32_t event)
         read.cb = nullptr;
         read.fiber.reset();
         read.scheduler = nullptr;
+        datagram = nullptr;
+        uring = false;
         break;
     case WRITE:
         write.cb = nullptr;
@@ -9,6 +9,8 @@
 #define __KCP_MANAGER_H__
 
 #include "kcp.h"
+#include "kcplistener.h"
+#include "kuring.h"
 #include "ktimer.h"
 #include "kschedule.h"
 #include <utils/singleton.h>
@@ -22,7 +24,14 @@ using namespace eular;
 class KcpManager : public KTimerManager, public KScheduler
 {
 public:
-    KcpManager(uint8_t threads, bool userCaller, const String8 &name);
+    // I/O引擎, IO_URING隐含multi-reactor模式, 初始化失败时该线程回退到epoll
+    enum class IoEngine {
+        EPOLL = 0,
+        IO_URING,
+    };
+
+    KcpManager(uint8_t threads, bool userCaller, const String8 &name, bool multiReactor = false,
+               IoEngine engine = IoEngine::EPOLL);
     virtual ~KcpManager();
 
     enum Event {
@@ -33,12 +42,17 @@ public:
 
     bool addKcp(Kcp::SP kcp);
     bool delKcp(Kcp::SP kcp);
+    bool addListener(KcpListener::SP listener);
+    bool delListener(KcpListener::SP listener);
+    std::vector<KcpListener::SP> createShardedListeners(const sockaddr_in &addr, const KcpListenerAttr &attr,
+                                                        bool convSteering = false);
 
     static KcpManager *GetThis();
 
 private:
     virtual void idle() override;
     virtual void tickle() override;
+    virtual void tickle(int th) override;
     virtual void onTimerInsertedAtFront() override;
 
     enum class KcpState {
@@ -48,6 +62,8 @@ private:
     };
 
     struct Context {
+        typedef std::function<void(const char *, int32_t, const sockaddr_in &)> DatagramCallback;
+
         struct EventContext {
             KScheduler *scheduler = nullptr;
             KFiber::SP fiber;
@@ -61,24 +77,48 @@ private:
 
         EventContext read;
         EventContext write;
+        DatagramCallback datagram;  // io_uring引擎下接收完成的回调
+        bool uring = false;         // 是否由io_uring多发recvmsg接收
         uint64_t timerId;
         uint32_t tid;
         int fd = 0;
+        int epollFd = -1;
         uint32_t events = NONE;
         Mutex mutex;
     };
 
     void contextResize(uint32_t size);
+    bool registerEvent(int epollFd, int fd, std::function<void()> readCb,
+                       std::function<void()> timerCb, int32_t interval, uint32_t recycle, uint32_t tid,
+                       Context::DatagramCallback datagramCb = nullptr);
+    void unregisterEvent(int fd);
+    void processListenerQueue(uint32_t tid, int &localEpollFd, int sessionEpollFd, uint32_t &localEventCount);
+    void processEvents(epoll_event *events, int nev, uint32_t tid);
+    void installUpdateHook(const Kcp::SP &kcp, uint32_t tid);
+    void onKcpUpdate(std::weak_ptr<Kcp> weak, uint64_t due);
+    int createLocalEpoll();
+    KUring *createUring(int localEpollFd);
     bool stopping(uint64_t &timeout);
 
 private:
     eular::Mutex mQueueMutex;
     std::map<Kcp::SP, KcpState, Kcp::KcpCompare> mWaitingQueue;
+    std::map<KcpListener::SP, KcpState> mListenerQueue;
     eular::Mutex mCtxMutex;
     std::vector<Context *>  mContextVec;
     std::atomic<uint16_t>   mEventCount;
     int         mEpollFd;
     int         mEventFd;
+
+    // multi-reactor模式下每个线程私有的epoll与eventfd, 会话直接注册到其所属线程并在该线程内联处理
+    struct Reactor {
+        int epollFd = -1;
+        int eventFd = -1;
+    };
+    const IoEngine mEngine;
+    const bool  mMultiReactor;
+    eular::Mutex mReactorMutex;
+    std::map<uint32_t, Reactor> mReactors;
 };
 
 typedef eular::Singleton<KcpManager> KcpManagerInstance;
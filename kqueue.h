@@ -0,0 +1,106 @@
+/*************************************************************************
+    > File Name: kqueue.h
+    > Author: hsz
+    > Brief:
+    > Created Time: Sat 17 Oct 2026 09:42:10 PM CST
+ ************************************************************************/
+
+#ifndef __KCP_QUEUE_H__
+#define __KCP_QUEUE_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#define KQUEUE_CACHE_LINE   64
+
+/**
+ * @brief 有界无锁多生产者单消费者环形队列, 槽位预先分配.
+ *        每个槽带序号: 序号==位置表示空闲, 序号==位置+1表示已发布.
+ *        生产者先以CAS预留槽位, 在槽内就地填写后再发布, 队列满时立即返回false
+ */
+template<typename T>
+class KMpscQueue
+{
+public:
+    explicit KMpscQueue(uint32_t capacity) :
+        mEnqueuePos(0),
+        mDequeuePos(0)
+    {
+        uint64_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mMask = size - 1;
+        mCells.reset(new Cell[size]);
+        for (uint64_t i = 0; i < size; ++i) {
+            mCells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    KMpscQueue(const KMpscQueue &) = delete;
+    KMpscQueue &operator=(const KMpscQueue &) = delete;
+
+    /**
+     * @brief 生产者调用, 预留槽位后以fill(T &)就地填写
+     *
+     * @return 队列满返回false, 此时fill不会被调用
+     */
+    template<typename Fill>
+    bool push(Fill &&fill)
+    {
+        Cell *cell = nullptr;
+        uint64_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &mCells[pos & mMask];
+            uint64_t seq = cell->seq.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+            if (diff == 0) {
+                if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        fill(cell->data);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 仅限单个消费者调用
+     */
+    bool pop(T &out)
+    {
+        Cell *cell = &mCells[mDequeuePos & mMask];
+        uint64_t seq = cell->seq.load(std::memory_order_acquire);
+        if (seq != mDequeuePos + 1) {
+            return false;
+        }
+
+        out = std::move(cell->data);
+        cell->seq.store(mDequeuePos + mMask + 1, std::memory_order_release);
+        ++mDequeuePos;
+        return true;
+    }
+
+    uint64_t capacity() const { return mMask + 1; }
+
+private:
+    struct Cell {
+        std::atomic<uint64_t> seq;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> mCells;
+    uint64_t mMask;
+    alignas(KQUEUE_CACHE_LINE) std::atomic<uint64_t> mEnqueuePos;
+    alignas(KQUEUE_CACHE_LINE) uint64_t mDequeuePos;
+};
+
+#endif // __KCP_QUEUE_H__
@@ -42,7 +42,7 @@ public:
             needTickle = scheduleNoLock(fc, th);
         }
         if (needTickle && mThreadCount > 0) {
-            tickle();
+            tickle(th);
         }
     }
 
@@ -72,6 +72,10 @@ protected:
      */
     virtual void idle();
     virtual void tickle();
+    /**
+     * @brief 唤醒将执行绑定到th线程任务的线程, th为0时等同于tickle()
+     */
+    virtual void tickle(int th) { tickle(); }
     virtual bool stopping();
 
     struct FiberBindThread {
@@ -0,0 +1,404 @@
+/*************************************************************************
+    > File Name: kslab.cpp
+    > Author: hsz
+    > Brief:
+    > Created Time: Mon 19 Oct 2026 09:15:31 AM CST
+ ************************************************************************/
+
+#include "kslab.h"
+#include "ikcp.h"
+#include <utils/mutex.h>
+#include <log/log.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <atomic>
+#include <new>
+
+#define LOG_TAG "kslab"
+
+#define KSLAB_DEFAULT_MTU       1400
+#define KSLAB_DEFAULT_BLOCKS    64
+#define KSLAB_DEFAULT_IDLE      1024
+#define KSLAB_ALIGN             16
+
+class KSlabPool;
+
+// 块头部, 用户数据紧随其后. next仅在块空闲时有效
+struct alignas(KSLAB_ALIGN) KSlabBlock {
+    struct KSlab   *slab;       // 所属slab, malloc兜底的块为nullptr
+    KSlabBlock     *next;
+};
+
+// slab头部位于mmap区域起始, 块紧随其后
+struct KSlab {
+    KSlabPool      *pool;
+    KSlabBlock     *free;       // 本slab的空闲块
+    uint32_t        used;
+    KSlab          *prev;       // 有空闲块的slab链表
+    KSlab          *next;
+    KSlab          *allPrev;    // 全部slab链表, 池回收时整体释放
+    KSlab          *allNext;
+};
+
+static uint32_t gBlockStride = 0;
+static uint32_t gBlockPayload = 0;
+static uint32_t gSlabBlocks = 0;
+static uint32_t gIdleBlocks = 0;
+static size_t   gSlabBytes = 0;
+static std::atomic<uint64_t> gReleasedSlabs(0);
+static std::atomic<uint64_t> gFallbacks(0);
+
+/**
+ * @brief 线程私有池. 计数仅由所属线程写入, 以relaxed原子变量存放以便统计时跨线程读取
+ */
+class KSlabPool
+{
+public:
+    KSlabPool();
+    ~KSlabPool();
+
+    void *  alloc();
+    void    freeOwned(KSlabBlock *block);
+    void    freeRemote(KSlabBlock *block);
+    void    orphan();
+    void    fillStats(KSlabStats &stats) const;
+
+    KSlabPool  *mRegistryNext;
+    KSlabPool  *mRegistryPrev;
+
+private:
+    KSlab * newSlab();
+    void    releaseSlab(KSlab *slab);
+    void    freeLocal(KSlabBlock *block);
+    void    drainRemote();
+    static void add(std::atomic<uint64_t> &counter, int64_t delta)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    KSlab                  *mPartial;       // 有空闲块的slab
+    KSlab                  *mAll;
+    uint64_t                mFreeBlocks;
+    int64_t                 mOwnedOut;      // 分配数减本线程释放数, 仅所属线程访问
+    std::atomic<uint64_t>   mSlabs;
+    std::atomic<uint64_t>   mUsedBlocks;
+    std::atomic<KSlabBlock *> mRemote;      // 其他线程归还的块, 无锁栈
+    std::atomic<int64_t>    mRemoteRefs;    // 远端释放各减一, 线程退出时加上mOwnedOut, 减到0的一方回收池
+};
+
+static eular::Mutex gRegistryMutex;
+static KSlabPool   *gRegistry = nullptr;    // 所有存活的池, 仅用于统计
+
+// 线程退出时将池标记为无主, 由最后归还的块回收
+struct KSlabPoolHolder {
+    KSlabPool *pool = nullptr;
+    ~KSlabPoolHolder();
+};
+
+static thread_local KSlabPool *gPool = nullptr;
+static thread_local bool gPoolExited = false;
+static thread_local KSlabPoolHolder gPoolHolder;
+
+KSlabPoolHolder::~KSlabPoolHolder()
+{
+    gPool = nullptr;
+    gPoolExited = true;
+    if (pool != nullptr) {
+        pool->orphan();
+    }
+}
+
+KSlabPool::KSlabPool() :
+    mRegistryNext(nullptr),
+    mRegistryPrev(nullptr),
+    mPartial(nullptr),
+    mAll(nullptr),
+    mFreeBlocks(0),
+    mOwnedOut(0),
+    mSlabs(0),
+    mUsedBlocks(0),
+    mRemote(nullptr),
+    mRemoteRefs(0)
+{
+    eular::AutoLock<eular::Mutex> lock(gRegistryMutex);
+    mRegistryNext = gRegistry;
+    if (gRegistry != nullptr) {
+        gRegistry->mRegistryPrev = this;
+    }
+    gRegistry = this;
+}
+
+KSlabPool::~KSlabPool()
+{
+    {
+        eular::AutoLock<eular::Mutex> lock(gRegistryMutex);
+        if (mRegistryPrev != nullptr) {
+            mRegistryPrev->mRegistryNext = mRegistryNext;
+        } else {
+            gRegistry = mRegistryNext;
+        }
+        if (mRegistryNext != nullptr) {
+            mRegistryNext->mRegistryPrev = mRegistryPrev;
+        }
+    }
+
+    // 块已全部归还, 无需逐个整理空闲链表
+    while (mAll != nullptr) {
+        KSlab *slab = mAll;
+        mAll = slab->allNext;
+        munmap(slab, gSlabBytes);
+        gReleasedSlabs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+KSlab *KSlabPool::newSlab()
+{
+    void *addr = mmap(nullptr, gSlabBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        LOGE("mmap(%zu) error. [%d, %s]", gSlabBytes, errno, strerror(errno));
+        return nullptr;
+    }
+
+    KSlab *slab = static_cast<KSlab *>(addr);
+    slab->pool = this;
+    slab->free = nullptr;
+    slab->used = 0;
+    char *base = static_cast<char *>(addr) + (sizeof(KSlab) + KSLAB_ALIGN - 1) / KSLAB_ALIGN * KSLAB_ALIGN;
+    for (uint32_t i = gSlabBlocks; i > 0; --i) {
+        KSlabBlock *block = reinterpret_cast<KSlabBlock *>(base + (i - 1) * gBlockStride);
+        block->slab = slab;
+        block->next = slab->free;
+        slab->free = block;
+    }
+
+    slab->prev = nullptr;
+    slab->next = mPartial;
+    if (mPartial != nullptr) {
+        mPartial->prev = slab;
+    }
+    mPartial = slab;
+
+    slab->allPrev = nullptr;
+    slab->allNext = mAll;
+    if (mAll != nullptr) {
+        mAll->allPrev = slab;
+    }
+    mAll = slab;
+
+    mFreeBlocks += gSlabBlocks;
+    add(mSlabs, 1);
+    return slab;
+}
+
+void KSlabPool::releaseSlab(KSlab *slab)
+{
+    if (slab->prev != nullptr) {
+        slab->prev->next = slab->next;
+    } else {
+        mPartial = slab->next;
+    }
+    if (slab->next != nullptr) {
+        slab->next->prev = slab->prev;
+    }
+
+    if (slab->allPrev != nullptr) {
+        slab->allPrev->allNext = slab->allNext;
+    } else {
+        mAll = slab->allNext;
+    }
+    if (slab->allNext != nullptr) {
+        slab->allNext->allPrev = slab->allPrev;
+    }
+
+    mFreeBlocks -= gSlabBlocks;
+    add(mSlabs, -1);
+    gReleasedSlabs.fetch_add(1, std::memory_order_relaxed);
+    munmap(slab, gSlabBytes);
+}
+
+void KSlabPool::drainRemote()
+{
+    KSlabBlock *block = mRemote.exchange(nullptr, std::memory_order_acquire);
+    while (block != nullptr) {
+        KSlabBlock *next = block->next;
+        freeLocal(block);
+        block = next;
+    }
+}
+
+void *KSlabPool::alloc()
+{
+    if (mPartial == nullptr) {
+        drainRemote();
+    }
+    if (mPartial == nullptr && newSlab() == nullptr) {
+        return nullptr;
+    }
+
+    KSlab *slab = mPartial;
+    KSlabBlock *block = slab->free;
+    slab->free = block->next;
+    ++slab->used;
+    if (slab->free == nullptr) {
+        mPartial = slab->next;
+        if (mPartial != nullptr) {
+            mPartial->prev = nullptr;
+        }
+    }
+
+    --mFreeBlocks;
+    ++mOwnedOut;
+    add(mUsedBlocks, 1);
+    return block + 1;
+}
+
+/**
+ * @brief 归还到所属slab. 计数由调用方处理: 本线程释放减mOwnedOut, 远端释放已在压栈时减过mRemoteRefs
+ */
+void KSlabPool::freeLocal(KSlabBlock *block)
+{
+    KSlab *slab = block->slab;
+    if (slab->free == nullptr) {
+        slab->prev = nullptr;
+        slab->next = mPartial;
+        if (mPartial != nullptr) {
+            mPartial->prev = slab;
+        }
+        mPartial = slab;
+    }
+    block->next = slab->free;
+    slab->free = block;
+    --slab->used;
+
+    ++mFreeBlocks;
+    add(mUsedBlocks, -1);
+    if (slab->used == 0 && mFreeBlocks > gIdleBlocks) {
+        releaseSlab(slab);
+    }
+}
+
+void KSlabPool::freeOwned(KSlabBlock *block)
+{
+    freeLocal(block);
+    --mOwnedOut;
+}
+
+void KSlabPool::freeRemote(KSlabBlock *block)
+{
+    KSlabBlock *head = mRemote.load(std::memory_order_relaxed);
+    do {
+        block->next = head;
+    } while (!mRemote.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+
+    // 所属线程存活时计数不大于0, 只有退出后才可能由此减到0
+    if (mRemoteRefs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+void KSlabPool::orphan()
+{
+    drainRemote();
+    KSlab *slab = mPartial;
+    while (slab != nullptr) {
+        KSlab *next = slab->next;
+        if (slab->used == 0) {
+            releaseSlab(slab);
+        }
+        slab = next;
+    }
+
+    if (mRemoteRefs.fetch_add(mOwnedOut, std::memory_order_acq_rel) + mOwnedOut == 0) {
+        delete this;
+    }
+}
+
+void KSlabPool::fillStats(KSlabStats &stats) const
+{
+    uint64_t slabs = mSlabs.load(std::memory_order_relaxed);
+    stats.slabs += slabs;
+    stats.blocks += slabs * gSlabBlocks;
+    stats.usedBlocks += mUsedBlocks.load(std::memory_order_relaxed);
+    int64_t remote = mRemoteRefs.load(std::memory_order_relaxed);
+    stats.remoteFrees += remote < 0 ? static_cast<uint64_t>(-remote) : 0;
+}
+
+void KSlabAllocator::Install(const KSlabConfig &config)
+{
+    uint32_t mtu = config.mtu ? config.mtu : KSLAB_DEFAULT_MTU;
+    gBlockPayload = sizeof(IKCPSEG) + mtu;
+    gBlockStride = (sizeof(KSlabBlock) + gBlockPayload + KSLAB_ALIGN - 1) / KSLAB_ALIGN * KSLAB_ALIGN;
+    gSlabBlocks = config.slabBlocks ? config.slabBlocks : KSLAB_DEFAULT_BLOCKS;
+    gIdleBlocks = config.idleBlocks ? config.idleBlocks : KSLAB_DEFAULT_IDLE;
+    gSlabBytes = (sizeof(KSlab) + KSLAB_ALIGN - 1) / KSLAB_ALIGN * KSLAB_ALIGN +
+        static_cast<size_t>(gBlockStride) * gSlabBlocks;
+
+    ikcp_allocator(&KSlabAllocator::Malloc, &KSlabAllocator::Free);
+}
+
+void *KSlabAllocator::Malloc(size_t size)
+{
+    if (size <= gBlockPayload && !gPoolExited) {
+        if (gPool == nullptr) {
+            gPool = new (std::nothrow) KSlabPool();
+            gPoolHolder.pool = gPool;
+        }
+        void *ptr = gPool ? gPool->alloc() : nullptr;
+        if (ptr != nullptr) {
+            return ptr;
+        }
+    }
+
+    gFallbacks.fetch_add(1, std::memory_order_relaxed);
+    KSlabBlock *block = static_cast<KSlabBlock *>(malloc(sizeof(KSlabBlock) + size));
+    if (block == nullptr) {
+        return nullptr;
+    }
+    block->slab = nullptr;
+    return block + 1;
+}
+
+void KSlabAllocator::Free(void *ptr)
+{
+    if (ptr == nullptr) {
+        return;
+    }
+
+    KSlabBlock *block = static_cast<KSlabBlock *>(ptr) - 1;
+    if (block->slab == nullptr) {
+        free(block);
+        return;
+    }
+
+    KSlabPool *pool = block->slab->pool;
+    if (pool == gPool) {
+        pool->freeOwned(block);
+    } else {
+        pool->freeRemote(block);
+    }
+}
+
+KSlabStats KSlabAllocator::GetStats()
+{
+    KSlabStats stats;
+    {
+        eular::AutoLock<eular::Mutex> lock(gRegistryMutex);
+        for (KSlabPool *pool = gRegistry; pool != nullptr; pool = pool->mRegistryNext) {
+            pool->fillStats(stats);
+        }
+    }
+    stats.releasedSlabs = gReleasedSlabs.load(std::memory_order_relaxed);
+    stats.fallbacks = gFallbacks.load(std::memory_order_relaxed);
+    return stats;
+}
+
+KSlabStats KSlabAllocator::GetThreadStats()
+{
+    KSlabStats stats;
+    if (gPool != nullptr) {
+        gPool->fillStats(stats);
+    }
+    return stats;
+}
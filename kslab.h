@@ -0,0 +1,65 @@
+/*************************************************************************
+    > File Name: kslab.h
+    > Author: hsz
+    > Brief:
+    > Created Time: Mon 19 Oct 2026 09:15:26 AM CST
+ ************************************************************************/
+
+#ifndef __KCP_SLAB_H__
+#define __KCP_SLAB_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct KSlabConfig
+{
+    uint32_t mtu;           // largest segment payload served from slabs, 0:1400(default), larger requests fall back to malloc
+    uint32_t slabBlocks;    // blocks per slab, one mmap each, 0:64(default)
+    uint32_t idleBlocks;    // free blocks a thread keeps cached, empty slabs beyond it are unmapped, 0:1024(default)
+
+    KSlabConfig() : mtu(0), slabBlocks(0), idleBlocks(0) {}
+};
+
+struct KSlabStats
+{
+    uint64_t slabs;         // slabs mapped
+    uint64_t blocks;        // block capacity of those slabs
+    uint64_t usedBlocks;    // blocks handed out
+    uint64_t remoteFrees;   // blocks returned by other threads
+    uint64_t releasedSlabs; // slabs unmapped after going idle
+    uint64_t fallbacks;     // requests too large for a block, served by malloc
+
+    KSlabStats() :
+        slabs(0), blocks(0), usedBlocks(0),
+        remoteFrees(0), releasedSlabs(0), fallbacks(0)
+    {
+    }
+};
+
+/**
+ * @brief ikcp段分配器: 每个线程一个池, 按slab批量mmap定长块, 分配与本线程释放均无锁无系统调用.
+ *        其他线程释放的块压入所属池的无锁栈, 由所属线程在空闲块耗尽时整体取回.
+ *        线程退出后池由最后一个归还的块回收
+ */
+class KSlabAllocator
+{
+public:
+    /**
+     * @brief 以ikcp_allocator安装, 必须在创建任何ikcp会话之前调用, 之后不可更改
+     */
+    static void         Install(const KSlabConfig &config = KSlabConfig());
+    static void *       Malloc(size_t size);
+    static void         Free(void *ptr);
+
+    /**
+     * @brief 全局统计, slabs/blocks/usedBlocks为所有线程之和, usedBlocks为近似值
+     */
+    static KSlabStats   GetStats();
+
+    /**
+     * @brief 调用线程所属池的统计
+     */
+    static KSlabStats   GetThreadStats();
+};
+
+#endif // __KCP_SLAB_H__
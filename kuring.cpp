@@ -0,0 +1,491 @@
+/*************************************************************************
+    > File Name: kuring.cpp
+    > Author: hsz
+    > Brief:
+    > Created Time: Sat 17 Oct 2026 08:05:21 PM CST
+ ************************************************************************/
+
+#include "kuring.h"
+#include <log/log.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_TAG "KUring"
+
+#define URING_BUF_GROUP     0
+#define URING_SEND_SLOTS    1024
+
+// user_data低3位作为类型标记, 高位为8字节对齐的指针
+enum UringTag {
+    TAG_RECV            = 0,
+    TAG_SEND            = 1,
+    TAG_TIMEOUT         = 2,
+    TAG_TIMEOUT_UPDATE  = 3,
+    TAG_POLL            = 4,
+    TAG_CANCEL          = 5,
+};
+#define TAG_MASK    7ULL
+
+static thread_local KUring *gUring = nullptr;
+
+static inline uint64_t makeUserData(const void *ptr, UringTag tag)
+{
+    return reinterpret_cast<uintptr_t>(ptr) | tag;
+}
+
+static inline int sys_io_uring_setup(uint32_t entries, io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+static inline int sys_io_uring_register(int fd, uint32_t opcode, void *arg, uint32_t nargs)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nargs);
+}
+
+KUring::KUring() :
+    mRingFd(-1),
+    mPollFd(-1),
+    mSqEntries(0),
+    mSqMask(0),
+    mSqeTail(0),
+    mSqeSubmitted(0),
+    mSqRing(MAP_FAILED),
+    mSqRingSize(0),
+    mCqRing(MAP_FAILED),
+    mCqRingSize(0),
+    mSqes(nullptr),
+    mSqesSize(0),
+    mBufRing(MAP_FAILED),
+    mBufRingSize(0),
+    mBufRingTail(nullptr),
+    mBufTail(0),
+    mBufCount(0),
+    mBufSize(0),
+    mTimeoutArmed(false)
+{
+}
+
+KUring::~KUring()
+{
+    release();
+}
+
+void KUring::release()
+{
+    if (gUring == this) {
+        gUring = nullptr;
+    }
+    if (mBufRing != MAP_FAILED) {
+        munmap(mBufRing, mBufRingSize);
+        mBufRing = MAP_FAILED;
+    }
+    if (mSqes != nullptr) {
+        munmap(mSqes, mSqesSize);
+        mSqes = nullptr;
+    }
+    if (mCqRing != MAP_FAILED && mCqRing != mSqRing) {
+        munmap(mCqRing, mCqRingSize);
+    }
+    mCqRing = MAP_FAILED;
+    if (mSqRing != MAP_FAILED) {
+        munmap(mSqRing, mSqRingSize);
+        mSqRing = MAP_FAILED;
+    }
+    if (mRingFd >= 0) {
+        close(mRingFd);
+        mRingFd = -1;
+    }
+}
+
+/**
+ * @brief 创建io_uring并注册提供缓冲环, 成功后成为当前线程的KUring
+ *
+ * @param entries SQ大小
+ * @param bufCount 接收缓冲个数, 须为2的幂
+ * @param bufSize 单个接收缓冲大小, 需容纳io_uring_recvmsg_out + sockaddr_in + 数据报
+ */
+bool KUring::init(uint32_t entries, uint32_t bufCount, uint32_t bufSize)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    mRingFd = sys_io_uring_setup(entries, &params);
+    if (mRingFd < 0) {
+        LOGW("io_uring_setup error. [%d, %s]", errno, strerror(errno));
+        return false;
+    }
+
+    mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        mSqRingSize = mCqRingSize = (mSqRingSize > mCqRingSize ? mSqRingSize : mCqRingSize);
+    }
+
+    mSqRing = mmap(nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQ_RING);
+    if (mSqRing == MAP_FAILED) {
+        LOGE("mmap sq ring error. [%d, %s]", errno, strerror(errno));
+        release();
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        mCqRing = mSqRing;
+    } else {
+        mCqRing = mmap(nullptr, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_CQ_RING);
+        if (mCqRing == MAP_FAILED) {
+            LOGE("mmap cq ring error. [%d, %s]", errno, strerror(errno));
+            release();
+            return false;
+        }
+    }
+
+    mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        LOGE("mmap sqes error. [%d, %s]", errno, strerror(errno));
+        release();
+        return false;
+    }
+    mSqes = static_cast<io_uring_sqe *>(sqes);
+
+    char *sq = static_cast<char *>(mSqRing);
+    char *cq = static_cast<char *>(mCqRing);
+    mSqHead = reinterpret_cast<uint32_t *>(sq + params.sq_off.head);
+    mSqTail = reinterpret_cast<uint32_t *>(sq + params.sq_off.tail);
+    mSqArray = reinterpret_cast<uint32_t *>(sq + params.sq_off.array);
+    mSqEntries = params.sq_entries;
+    mSqMask = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+    mCqHead = reinterpret_cast<uint32_t *>(cq + params.cq_off.head);
+    mCqTail = reinterpret_cast<uint32_t *>(cq + params.cq_off.tail);
+    mCqMask = *reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+    mCqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    for (uint32_t i = 0; i < mSqEntries; ++i) {
+        mSqArray[i] = i;
+    }
+    mSqeTail = mSqeSubmitted = *mSqTail;
+
+    // 提供缓冲环, tail与bufs[0].resv重叠(偏移14)
+    mBufCount = bufCount;
+    mBufSize = bufSize;
+    mBufRingSize = bufCount * sizeof(io_uring_buf);
+    mBufRing = mmap(nullptr, mBufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mBufRing == MAP_FAILED) {
+        LOGE("mmap buffer ring error. [%d, %s]", errno, strerror(errno));
+        release();
+        return false;
+    }
+    mBufRingTail = reinterpret_cast<uint16_t *>(static_cast<char *>(mBufRing) + 14);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uintptr_t>(mBufRing);
+    reg.ring_entries = bufCount;
+    reg.bgid = URING_BUF_GROUP;
+    if (sys_io_uring_register(mRingFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        LOGW("IORING_REGISTER_PBUF_RING error. [%d, %s]", errno, strerror(errno));
+        release();
+        return false;
+    }
+
+    mBuffers.resize(static_cast<size_t>(bufCount) * bufSize);
+    mBufTail = 0;
+    for (uint32_t i = 0; i < bufCount; ++i) {
+        recycleBuffer(i);
+    }
+    __atomic_store_n(mBufRingTail, mBufTail, __ATOMIC_RELEASE);
+
+    mSendSlots.resize(URING_SEND_SLOTS);
+    mFreeSlots.reserve(URING_SEND_SLOTS);
+    for (auto &slot : mSendSlots) {
+        slot.reset(new SendSlot);
+        mFreeSlots.push_back(slot.get());
+    }
+
+    gUring = this;
+    return true;
+}
+
+KUring *KUring::Current()
+{
+    return gUring;
+}
+
+io_uring_sqe *KUring::getSqe()
+{
+    uint32_t head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+    if (mSqeTail - head >= mSqEntries) {
+        // SQ已满, 先提交已填充的SQE
+        if (submit(0) < 0) {
+            return nullptr;
+        }
+        head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+        if (mSqeTail - head >= mSqEntries) {
+            return nullptr;
+        }
+    }
+
+    io_uring_sqe *sqe = &mSqes[mSqeTail & mSqMask];
+    ++mSqeTail;
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    return sqe;
+}
+
+int KUring::submit(uint32_t minComplete)
+{
+    __atomic_store_n(mSqTail, mSqeTail, __ATOMIC_RELEASE);
+    uint32_t toSubmit = mSqeTail - mSqeSubmitted;
+    uint32_t flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+    if (toSubmit == 0 && minComplete == 0) {
+        return 0;
+    }
+
+    int ret = sys_io_uring_enter(mRingFd, toSubmit, minComplete, flags);
+    if (ret < 0) {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            LOGE("io_uring_enter error. [%d, %s]", errno, strerror(errno));
+        }
+        return -1;
+    }
+    mSqeSubmitted += ret;
+    return ret;
+}
+
+bool KUring::submitRecv(RecvSource *source)
+{
+    io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = source->fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(&source->msg);
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = makeUserData(source, TAG_RECV);
+    return true;
+}
+
+bool KUring::armRecv(int fd, void *owner)
+{
+    std::unique_ptr<RecvSource> source(new RecvSource);
+    source->owner = owner;
+    source->fd = fd;
+    source->canceled = false;
+    memset(&source->msg, 0, sizeof(msghdr));
+    source->msg.msg_namelen = sizeof(sockaddr_in);
+
+    if (!submitRecv(source.get())) {
+        return false;
+    }
+    mRecvOwners[owner] = source.get();
+    mRecvSources[source.get()] = std::move(source);
+    return true;
+}
+
+void KUring::cancelRecv(void *owner)
+{
+    auto it = mRecvOwners.find(owner);
+    if (it == mRecvOwners.end()) {
+        return;
+    }
+    RecvSource *source = it->second;
+    source->canceled = true;
+    mRecvOwners.erase(it);
+
+    io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(source, TAG_RECV);
+    sqe->user_data = TAG_CANCEL;
+}
+
+bool KUring::pollAdd(int fd)
+{
+    io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = TAG_POLL;
+    mPollFd = fd;
+    return true;
+}
+
+bool KUring::queueSend(int fd, const sockaddr_in &addr, const char *buf, int32_t len)
+{
+    if (mFreeSlots.empty() || len <= 0 || static_cast<size_t>(len) > sizeof(SendSlot::data)) {
+        return false;
+    }
+
+    SendSlot *slot = mFreeSlots.back();
+    io_uring_sqe *sqe = getSqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    mFreeSlots.pop_back();
+
+    memcpy(slot->data, buf, len);
+    slot->addr = addr;
+    slot->iov.iov_base = slot->data;
+    slot->iov.iov_len = len;
+    memset(&slot->msg, 0, sizeof(msghdr));
+    slot->msg.msg_name = &slot->addr;
+    slot->msg.msg_namelen = sizeof(sockaddr_in);
+    slot->msg.msg_iov = &slot->iov;
+    slot->msg.msg_iovlen = 1;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(&slot->msg);
+    sqe->len = 1;
+    sqe->user_data = makeUserData(slot, TAG_SEND);
+    return true;
+}
+
+void KUring::recycleBuffer(uint16_t bid)
+{
+    io_uring_buf *bufs = static_cast<io_uring_buf *>(mBufRing);
+    io_uring_buf &buf = bufs[mBufTail & (mBufCount - 1)];
+    buf.addr = reinterpret_cast<uintptr_t>(&mBuffers[static_cast<size_t>(bid) * mBufSize]);
+    buf.len = mBufSize;
+    buf.bid = bid;
+    ++mBufTail;
+}
+
+int KUring::wait(uint64_t timeoutMs, bool &pollReady)
+{
+    pollReady = false;
+    // 内核在提交时拷贝timespec, 须存活到本函数内的io_uring_enter
+    __kernel_timespec ts;
+    if (timeoutMs != UINT64_MAX) {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000;
+        io_uring_sqe *sqe = getSqe();
+        if (sqe != nullptr) {
+            if (mTimeoutArmed) {
+                sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+                sqe->addr = TAG_TIMEOUT;
+                sqe->addr2 = reinterpret_cast<uintptr_t>(&ts);
+                sqe->timeout_flags = IORING_TIMEOUT_UPDATE;
+                sqe->user_data = TAG_TIMEOUT_UPDATE;
+            } else {
+                sqe->opcode = IORING_OP_TIMEOUT;
+                sqe->fd = -1;
+                sqe->addr = reinterpret_cast<uintptr_t>(&ts);
+                sqe->len = 1;
+                sqe->off = 0;   // 纯定时, 不按完成数触发
+                sqe->user_data = TAG_TIMEOUT;
+                mTimeoutArmed = true;
+            }
+        }
+    }
+    // EBUSY表示CQ积压, 先收割完成事件
+    if (submit(1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        return -1;
+    }
+
+    int count = 0;
+    uint32_t head = *mCqHead;
+    uint32_t tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        handleCqe(&mCqes[head & mCqMask], pollReady);
+        ++head;
+        ++count;
+        if (head == tail) {
+            __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+            tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+        }
+    }
+    __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+    __atomic_store_n(mBufRingTail, mBufTail, __ATOMIC_RELEASE);
+    return count;
+}
+
+void KUring::handleCqe(const io_uring_cqe *cqe, bool &pollReady)
+{
+    uint64_t tag = cqe->user_data & TAG_MASK;
+    void *ptr = reinterpret_cast<void *>(cqe->user_data & ~TAG_MASK);
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+
+    switch (tag) {
+    case TAG_RECV:
+    {
+        auto it = mRecvSources.find(static_cast<RecvSource *>(ptr));
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            const char *buf = &mBuffers[static_cast<size_t>(bid) * mBufSize];
+            if (cqe->res > 0 && it != mRecvSources.end() && !it->second->canceled) {
+                RecvSource *source = it->second.get();
+                const io_uring_recvmsg_out *out = reinterpret_cast<const io_uring_recvmsg_out *>(buf);
+                const char *name = buf + sizeof(io_uring_recvmsg_out);
+                const char *payload = name + source->msg.msg_namelen + source->msg.msg_controllen;
+                if (out->flags & MSG_TRUNC) {
+                    LOGE("datagram truncated, larger than %u", mBufSize);
+                } else if (mDatagramCb) {
+                    sockaddr_in addr;
+                    memcpy(&addr, name, sizeof(sockaddr_in));
+                    mDatagramCb(source->owner, payload, out->payloadlen, addr);
+                }
+            }
+            recycleBuffer(bid);
+        }
+
+        if (more || it == mRecvSources.end()) {
+            break;
+        }
+        if (it->second->canceled || cqe->res == -ECANCELED) {
+            mRecvSources.erase(it);
+            break;
+        }
+        // 多发请求终止(如缓冲耗尽ENOBUFS), 重新提交
+        if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+            LOGE("multishot recvmsg(%d) error. [%d, %s]", it->second->fd, -cqe->res, strerror(-cqe->res));
+            int err = -cqe->res;
+            void *owner = it->second->owner;
+            mRecvOwners.erase(owner);
+            mRecvSources.erase(it);
+            if (mErrorCb) {
+                mErrorCb(owner, err);
+            }
+            break;
+        }
+        submitRecv(it->second.get());
+        break;
+    }
+    case TAG_SEND:
+    {
+        if (cqe->res < 0 && cqe->res != -EAGAIN) {
+            LOGE("sendmsg error. [%d, %s]", -cqe->res, strerror(-cqe->res));
+        }
+        mFreeSlots.push_back(static_cast<SendSlot *>(ptr));
+        break;
+    }
+    case TAG_TIMEOUT:
+        mTimeoutArmed = false;
+        break;
+    case TAG_POLL:
+        pollReady = true;
+        if (!more && mPollFd >= 0) {
+            pollAdd(mPollFd);
+        }
+        break;
+    default:    // TAG_TIMEOUT_UPDATE, TAG_CANCEL
+        break;
+    }
+}
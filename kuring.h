@@ -0,0 +1,121 @@
+/*************************************************************************
+    > File Name: kuring.h
+    > Author: hsz
+    > Brief:
+    > Created Time: Sat 17 Oct 2026 08:05:17 PM CST
+ ************************************************************************/
+
+#ifndef __KCP_URING_H__
+#define __KCP_URING_H__
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include <functional>
+#include <vector>
+#include <map>
+#include <memory>
+
+/**
+ * @brief 线程私有的io_uring, 直接使用系统调用(不依赖liburing).
+ *        入口: 多发(multishot)recvmsg + 提供缓冲环(provided buffer ring)
+ *        出口: 每个数据报一个sendmsg SQE, 随下一次io_uring_enter批量提交
+ *        等待: timeout SQE代替epoll_wait超时, 另以多发poll监听线程的epoll fd
+ */
+class KUring
+{
+public:
+    typedef std::function<void(void *owner, const char *buf, int32_t len, const sockaddr_in &addr)> DatagramCallback;
+    typedef std::function<void(void *owner, int err)> ErrorCallback;
+
+    KUring();
+    ~KUring();
+
+    bool init(uint32_t entries, uint32_t bufCount, uint32_t bufSize);
+    static KUring *Current();
+
+    bool armRecv(int fd, void *owner);
+    void cancelRecv(void *owner);
+    bool pollAdd(int fd);
+    bool queueSend(int fd, const sockaddr_in &addr, const char *buf, int32_t len);
+
+    /**
+     * @brief 提交排队的SQE并至少等待一个完成事件
+     *
+     * @param timeoutMs 最长等待时间, UINT64_MAX表示不设超时
+     * @param pollReady 被poll的fd就绪时置为true
+     * @return 处理的完成事件数, 出错返回-1
+     */
+    int wait(uint64_t timeoutMs, bool &pollReady);
+
+    void setDatagramCallback(DatagramCallback cb) { mDatagramCb.swap(cb); }
+    void setErrorCallback(ErrorCallback cb) { mErrorCb.swap(cb); }
+
+private:
+    struct RecvSource {
+        void    *owner;
+        int     fd;
+        bool    canceled;
+        msghdr  msg;
+    };
+
+    struct SendSlot {
+        msghdr      msg;
+        iovec       iov;
+        sockaddr_in addr;
+        char        data[2048];
+    };
+
+    io_uring_sqe *getSqe();
+    int  submit(uint32_t minComplete);
+    bool submitRecv(RecvSource *source);
+    void recycleBuffer(uint16_t bid);
+    void handleCqe(const io_uring_cqe *cqe, bool &pollReady);
+    void release();
+
+private:
+    int         mRingFd;
+    int         mPollFd;
+    uint32_t    mSqEntries;
+    uint32_t    mSqMask;
+    uint32_t    mSqeTail;       // 本地已填充的SQE位置
+    uint32_t    mSqeSubmitted;  // 已发布到内核的位置
+
+    void        *mSqRing;
+    size_t      mSqRingSize;
+    void        *mCqRing;
+    size_t      mCqRingSize;
+    io_uring_sqe *mSqes;
+    size_t      mSqesSize;
+
+    uint32_t    *mSqHead;
+    uint32_t    *mSqTail;
+    uint32_t    *mSqArray;
+    uint32_t    *mCqHead;
+    uint32_t    *mCqTail;
+    uint32_t    mCqMask;
+    io_uring_cqe *mCqes;
+
+    void        *mBufRing;      // provided buffer ring
+    size_t      mBufRingSize;
+    uint16_t    *mBufRingTail;
+    uint16_t    mBufTail;
+    uint32_t    mBufCount;
+    uint32_t    mBufSize;
+    std::vector<char> mBuffers;
+
+    bool        mTimeoutArmed;
+
+    // 每次armRecv一个RecvSource, user_data指向它而不是owner: fd关闭后重新注册会复用同一owner,
+    // 旧请求最后的-ECANCELED只能结束旧请求
+    std::map<RecvSource *, std::unique_ptr<RecvSource>> mRecvSources;
+    std::map<void *, RecvSource *> mRecvOwners;    // owner当前有效的请求, 取消时移除
+    std::vector<std::unique_ptr<SendSlot>> mSendSlots;
+    std::vector<SendSlot *> mFreeSlots;
+
+    DatagramCallback mDatagramCb;
+    ErrorCallback    mErrorCb;
+};
+
+#endif // __KCP_URING_H__
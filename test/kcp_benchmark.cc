@@ -6,9 +6,11 @@
  ************************************************************************/
 
 #include "../kcpmanager.h"
+#include "../kslab.h"
 #include <assert.h>
 #include <iostream>
 #include <signal.h>
+#include <getopt.h>
 #include <log/log.h>
 #include <log/callstack.h>
 
@@ -67,6 +69,10 @@ void onTimerEvent(Kcp *kcp)
     } else {
         LOGW("onTimerEvent() %d b/s", recvSize);
     }
+
+    KcpStats stats = kcp->getStats();
+    LOGW("onTimerEvent() recv %.2f pkts/call, send %.2f pkts/call",
+        stats.recvPacketsPerCall(), stats.sendPacketsPerCall());
 }
 
 void signalCatch(int sig)
@@ -85,7 +91,39 @@ int main(int argc, char **argv)
 
     eular::log::InitLog(LogLevel::LEVEL_INFO);
 
-    KcpManager *manager = KcpManagerInstance::Get(1, true, "test_kcp_server");
+    uint32_t udpGso = 0;
+    uint32_t udpGro = 0;
+    uint32_t sack = 0;
+    uint32_t ackEvery = 0;
+    KcpManager::IoEngine engine = KcpManager::IoEngine::EPOLL;
+    int opt;
+    while ((opt = getopt(argc, argv, "grusma:")) != -1) {
+        switch (opt) {
+        case 'g':   // UDP GSO
+            udpGso = 1;
+            break;
+        case 'r':   // UDP GRO
+            udpGro = 1;
+            break;
+        case 'u':   // io_uring
+            engine = KcpManager::IoEngine::IO_URING;
+            break;
+        case 's':   // selective ack
+            sack = 1;
+            break;
+        case 'm':   // slab segment allocator, before any session is created
+            KSlabAllocator::Install();
+            break;
+        case 'a':   // delayed ack, segments per ack
+            ackEvery = atoi(optarg);
+            break;
+        default:
+            printf("usage: %s [-g] [-r] [-u] [-s] [-m] [-a segments]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    KcpManager *manager = KcpManagerInstance::Get(1, true, "test_kcp_server", false, engine);
 
     int udp = createSocket();
     assert(udp > 0);
@@ -102,6 +140,10 @@ int main(int argc, char **argv)
     attr.fastResend = 2;
     attr.sendWndSize = 10240;
     attr.recvWndSize = 10240;
+    attr.udpGso = udpGso;
+    attr.udpGro = udpGro;
+    attr.sack = sack;
+    attr.ackEvery = ackEvery;
 
     Kcp::SP kcp(new Kcp(attr));
     kcp->installRecvEvent(std::bind(onReadEvent, kcp.get(), std::placeholders::_1, std::placeholders::_2));
@@ -0,0 +1,210 @@
+/*************************************************************************
+    > File Name: kcp_cc_sim.cc
+    > Author: hsz
+    > Brief:
+    > Created Time: Sun 18 Oct 2026 03:12:40 PM CST
+ ************************************************************************/
+
+// 拥塞控制对比: 虚拟时钟下的模拟链路(瓶颈带宽, 单向时延, 随机丢包, 尾部丢弃的瓶颈队列),
+// 发送端持续灌满, 统计接收端有效吞吐. 控制器给出pacing速率时发送端按令牌桶发出, 与Kcp的pacingAuto一致.
+// 第二组对比接收端延迟确认(每N段确认一次)对吞吐, srtt与反向数据报数的影响
+
+#include "../ikcp.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+
+#define SIM_MTU         1400
+#define SIM_WND         4096
+#define SIM_INTERVAL    10
+#define SIM_SECONDS     30
+
+struct Packet {
+    double      arrival;
+    std::string data;
+};
+
+struct Link {
+    double      bandwidth;      // bytes/ms, 0为不限速
+    uint32_t    delay;          // ms
+    uint32_t    lossPermille;
+    double      bufferBytes;
+    double      busyUntil = 0;
+    uint64_t    drops = 0;
+    uint64_t    packets = 0;
+    uint64_t    bytes = 0;
+    std::deque<Packet> inflight;
+};
+
+struct Endpoint {
+    ikcpcb     *kcp = nullptr;
+    Link       *link = nullptr;
+    bool        paced = false;
+    double      tokens = 0;
+    std::deque<std::string> pending;    // 等待令牌的数据报
+};
+
+static double   gNow = 0;
+static uint32_t gSeed = 12345;
+
+static uint32_t nextRandom()
+{
+    gSeed = gSeed * 1103515245 + 12345;
+    return (gSeed >> 16) & 0x7fff;
+}
+
+static void linkSend(Link *link, const char *buf, int len)
+{
+    ++link->packets;
+    link->bytes += len;
+    if (nextRandom() % 1000 < link->lossPermille) {
+        ++link->drops;
+        return;
+    }
+
+    double start = link->busyUntil > gNow ? link->busyUntil : gNow;
+    if (link->bandwidth > 0) {
+        if ((start - gNow) * link->bandwidth + len > link->bufferBytes) {
+            ++link->drops;
+            return;
+        }
+        link->busyUntil = start + len / link->bandwidth;
+    } else {
+        link->busyUntil = start;
+    }
+    link->inflight.push_back(Packet{link->busyUntil + link->delay, std::string(buf, len)});
+}
+
+static int output(const char *buf, int len, ikcpcb *kcp, void *user)
+{
+    Endpoint *ep = static_cast<Endpoint *>(user);
+    if (ep->paced && ikcp_pacing_rate(kcp) > 0) {
+        ep->pending.emplace_back(buf, len);
+    } else {
+        linkSend(ep->link, buf, len);
+    }
+    return len;
+}
+
+// 每毫秒按pacing速率补充令牌并释放暂存的数据报
+static void drainPaced(Endpoint *ep)
+{
+    double rate = ikcp_pacing_rate(ep->kcp) / 1000.0;
+    double burst = 4 * SIM_MTU;
+    ep->tokens = ep->tokens + rate > burst ? burst : ep->tokens + rate;
+    while (!ep->pending.empty() && (rate == 0 || ep->tokens >= ep->pending.front().size())) {
+        ep->tokens -= ep->pending.front().size();
+        linkSend(ep->link, ep->pending.front().data(), ep->pending.front().size());
+        ep->pending.pop_front();
+    }
+}
+
+static void deliver(Link *link, ikcpcb *to)
+{
+    while (!link->inflight.empty() && link->inflight.front().arrival <= gNow) {
+        ikcp_input(to, link->inflight.front().data.data(), link->inflight.front().data.size());
+        link->inflight.pop_front();
+    }
+}
+
+static ikcpcb *createKcp(Endpoint *ep, const ikcpcc *cc)
+{
+    ikcpcb *kcp = ikcp_create(0x2048, ep);
+    ikcp_setoutput(kcp, output);
+    ikcp_setmtu(kcp, SIM_MTU);
+    ikcp_wndsize(kcp, SIM_WND, SIM_WND);
+    ikcp_nodelay(kcp, 1, SIM_INTERVAL, 2, 0);
+    ikcp_setcc(kcp, cc);
+    ep->kcp = kcp;
+    return kcp;
+}
+
+static void simulate(const char *scenario, uint32_t mbps, uint32_t delay, uint32_t lossPermille,
+                     const ikcpcc *cc, uint32_t ackEvery = 0)
+{
+    Link forward;
+    forward.bandwidth = mbps * 1000.0 * 1000 / 8 / 1000;
+    forward.delay = delay;
+    forward.lossPermille = lossPermille;
+    forward.bufferBytes = forward.bandwidth * delay * 2;    // 一个BDP
+    Link reverse;
+    reverse.bandwidth = 0;
+    reverse.delay = delay;
+    reverse.lossPermille = lossPermille;
+    reverse.bufferBytes = 0;
+
+    Endpoint sender, receiver;
+    sender.link = &forward;
+    sender.paced = true;
+    receiver.link = &reverse;
+    ikcpcb *src = createKcp(&sender, cc);
+    ikcpcb *dst = createKcp(&receiver, &ikcp_cc_default);
+    ikcp_ackdelay(dst, ackEvery, 0);
+
+    gNow = 0;
+    gSeed = 12345;
+    char chunk[SIM_MTU - 24] = {0};
+    static char buffer[SIM_WND * SIM_MTU];
+    uint64_t received = 0;
+    uint64_t srttSum = 0, srttCount = 0;
+    for (uint32_t ms = 0; ms < SIM_SECONDS * 1000; ++ms) {
+        gNow = ms;
+        deliver(&forward, dst);
+        deliver(&reverse, src);
+
+        while (ikcp_waitsnd(src) < (int)SIM_WND * 2) {
+            ikcp_send(src, chunk, sizeof(chunk));
+        }
+        ikcp_update(src, ms);
+        ikcp_update(dst, ms);
+        drainPaced(&sender);
+
+        int n;
+        while ((n = ikcp_recv(dst, buffer, sizeof(buffer))) > 0) {
+            received += n;
+        }
+        if (ms % 100 == 0 && src->rx_srtt > 0) {
+            srttSum += src->rx_srtt;
+            ++srttCount;
+        }
+    }
+
+    printf("%-24s %-8s %6u %10.2f %10lu %10lu %10lu %10lu\n", scenario, cc->name, ackEvery,
+        received * 8.0 / SIM_SECONDS / 1000 / 1000, (unsigned long)(srttCount ? srttSum / srttCount : 0),
+        (unsigned long)forward.drops, (unsigned long)reverse.packets, (unsigned long)(reverse.bytes / 1024));
+    ikcp_release(src);
+    ikcp_release(dst);
+}
+
+int main(int argc, char **argv)
+{
+    struct Scenario {
+        const char *name;
+        uint32_t    mbps;
+        uint32_t    delay;
+        uint32_t    lossPermille;
+    } scenarios[] = {
+        {"20Mbps 100ms 0%",     20, 50, 0},
+        {"20Mbps 100ms 1%",     20, 50, 10},
+        {"50Mbps 200ms 1%",     50, 100, 10},
+        {"50Mbps 200ms 3%",     50, 100, 30},
+    };
+
+    printf("%-24s %-8s %6s %10s %10s %10s %10s %10s\n", "link(bw rtt loss)", "cc", "ack/N", "Mbit/s", "srtt(ms)",
+        "drops", "acks", "ack KB");
+    for (const Scenario &s : scenarios) {
+        simulate(s.name, s.mbps, s.delay, s.lossPermille, &ikcp_cc_default);
+        simulate(s.name, s.mbps, s.delay, s.lossPermille, &ikcp_cc_bbr);
+    }
+
+    printf("\n");
+    const uint32_t ackEvery[] = {0, 4, 16, 32};
+    for (const Scenario &s : scenarios) {
+        for (uint32_t n : ackEvery) {
+            simulate(s.name, s.mbps, s.delay, s.lossPermille, &ikcp_cc_bbr, n);
+        }
+    }
+    return 0;
+}
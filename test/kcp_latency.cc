@@ -0,0 +1,151 @@
+/*************************************************************************
+    > File Name: kcp_latency.cc
+    > Author: hsz
+    > Brief:
+    > Created Time: Sun 18 Oct 2026 10:21:47 AM CST
+ ************************************************************************/
+
+// 回环单向时延: 同一进程内两个会话, 发送端每period毫秒在所属线程发送一条带时间戳的消息,
+// 接收端统计p50/p99. -l开启低延迟模式, 不加为interval驱动模式
+
+#include "../kcpmanager.h"
+#include <assert.h>
+#include <signal.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <log/log.h>
+
+#define LOG_TAG     "kcp-latency"
+#define PORT_A      12100
+#define PORT_B      12101
+
+static std::vector<int64_t> gSamples;
+static uint32_t gSampleCount = 2000;
+static uint8_t  gLowLatency = 0;
+static int32_t  gInterval = 20;
+
+static int64_t nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int createSocket(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("create socket fail!");
+        return -1;
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("socket bind fail!");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static Kcp::SP createKcp(int fd, uint16_t peerPort)
+{
+    KcpAttr attr;
+    attr.fd = fd;
+    attr.autoClose = true;
+    attr.conv = 0x2048;
+    attr.interval = gInterval;
+    attr.nodelay = 1;
+    attr.fastResend = 2;
+    attr.lowLatency = gLowLatency;
+    attr.addr.sin_family = AF_INET;
+    attr.addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    attr.addr.sin_port = htons(peerPort);
+    return Kcp::SP(new Kcp(attr));
+}
+
+static int64_t percentile(const std::vector<int64_t> &sorted, double p)
+{
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+static void onReadEvent(ByteBuffer &buffer, sockaddr_in addr)
+{
+    int64_t sendUs = 0;
+    if (buffer.size() < sizeof(sendUs)) {
+        return;
+    }
+    memcpy(&sendUs, buffer.data(), sizeof(sendUs));
+    gSamples.push_back(nowUs() - sendUs);
+    if (gSamples.size() < gSampleCount) {
+        return;
+    }
+
+    std::sort(gSamples.begin(), gSamples.end());
+    printf("mode: %s, interval: %d ms, samples: %zu\n", gLowLatency ? "low-latency" : "interval",
+        gInterval, gSamples.size());
+    printf("one-way delay p50: %ld us, p99: %ld us, max: %ld us\n", (long)percentile(gSamples, 0.5),
+        (long)percentile(gSamples, 0.99), (long)gSamples.back());
+    exit(0);
+}
+
+static void onSendTimer(Kcp *kcp)
+{
+    char msg[64] = {0};
+    int64_t sendUs = nowUs();
+    memcpy(msg, &sendUs, sizeof(sendUs));
+    kcp->send(ByteBuffer(msg, sizeof(msg)));
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t period = 7;    // 与interval错开, 避免发送总落在flush边界
+    int opt;
+    while ((opt = getopt(argc, argv, "li:n:p:")) != -1) {
+        switch (opt) {
+        case 'l':
+            gLowLatency = 1;
+            break;
+        case 'i':
+            gInterval = atoi(optarg);
+            break;
+        case 'n':
+            gSampleCount = atoi(optarg);
+            break;
+        case 'p':
+            period = atoi(optarg);
+            break;
+        default:
+            printf("usage: %s [-l] [-i interval] [-n samples] [-p period]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    eular::log::InitLog(LogLevel::LEVEL_WARN);
+    gSamples.reserve(gSampleCount);
+
+    // 单线程: 定时器与两个会话都在调用线程上, 发送即发生在所属线程
+    KcpManager *manager = KcpManagerInstance::Get(1, true, "kcp_latency");
+
+    int fdA = createSocket(PORT_A);
+    int fdB = createSocket(PORT_B);
+    assert(fdA > 0 && fdB > 0);
+
+    Kcp::SP sender = createKcp(fdA, PORT_B);
+    Kcp::SP receiver = createKcp(fdB, PORT_A);
+    receiver->installRecvEvent(onReadEvent);
+
+    manager->addKcp(sender);
+    manager->addKcp(receiver);
+    manager->addTimer(period, std::bind(onSendTimer, sender.get()), period);
+    KcpManager::GetMainFiber()->resume();
+
+    return 0;
+}
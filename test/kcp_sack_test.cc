@@ -0,0 +1,145 @@
+/*************************************************************************
+    > File Name: kcp_sack_test.cc
+    > Author: hsz
+    > Brief:
+    > Created Time: Tue 20 Oct 2026 02:20:11 PM CST
+ ************************************************************************/
+
+// 选择确认回归: 直接构造对端报文输入ikcp, 检查输出的IKCP_CMD_SACK区间.
+// 接收窗口128, 127个段按序到达且未被读取, 之后sn 128先于127到达: rcv_queue已满, rcv_nxt留在rcv_buf中,
+// 区间应为[128, 129)而不是绕过环形缓冲的错误区间.
+// 发送端sn 0丢失, 之后逐个确认1..4的sack使其fastack越过重传阈值, 只应加入fastlist一次
+
+#include "../ikcp.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define CMD_PUSH    81
+#define CMD_SACK    85
+#define CMD_WINS    84
+#define SACK_HELLO  1
+#define OVERHEAD    24
+
+static std::vector<std::string> gOutput;
+
+static int output(const char *buf, int len, ikcpcb *kcp, void *user)
+{
+    gOutput.push_back(std::string(buf, len));
+    return 0;
+}
+
+static void encode32u(std::string &buf, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        buf.push_back((char)((value >> (i * 8)) & 0xff));
+    }
+}
+
+static uint32_t decode32u(const char *buf)
+{
+    const uint8_t *ptr = (const uint8_t *)buf;
+    return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((uint32_t)ptr[3] << 24);
+}
+
+static void input(ikcpcb *kcp, uint8_t cmd, uint8_t frg, uint32_t sn, uint32_t una, const std::string &payload)
+{
+    std::string buf;
+    encode32u(buf, kcp->conv);
+    buf.push_back((char)cmd);
+    buf.push_back((char)frg);
+    buf.push_back((char)128);
+    buf.push_back(0);
+    encode32u(buf, 0);          // ts
+    encode32u(buf, sn);
+    encode32u(buf, una);
+    encode32u(buf, payload.size());
+    buf += payload;
+    ikcp_input(kcp, buf.data(), buf.size());
+}
+
+// 取输出中第一个IKCP_CMD_SACK的una与区间
+static bool findSack(uint32_t &una, std::vector<std::pair<uint32_t, uint32_t>> &ranges)
+{
+    for (const std::string &pkt : gOutput) {
+        for (size_t offset = 0; offset + OVERHEAD <= pkt.size(); ) {
+            const char *seg = pkt.data() + offset;
+            uint32_t len = decode32u(seg + 20);
+            if ((uint8_t)seg[4] == CMD_SACK) {
+                una = decode32u(seg + 16);
+                for (uint32_t i = 0; i < len / 8; ++i) {
+                    ranges.push_back(std::make_pair(decode32u(seg + OVERHEAD + i * 8),
+                        decode32u(seg + OVERHEAD + i * 8 + 4)));
+                }
+                return true;
+            }
+            offset += OVERHEAD + len;
+        }
+    }
+    return false;
+}
+
+static bool testFullQueue()
+{
+    ikcpcb *kcp = ikcp_create(0x1024, nullptr);
+    ikcp_setoutput(kcp, output);
+    ikcp_setsack(kcp, 1);
+    ikcp_wndsize(kcp, 128, 128);
+    ikcp_nodelay(kcp, 1, 10, 2, 1);
+    ikcp_update(kcp, 0);
+
+    input(kcp, CMD_WINS, SACK_HELLO, 0, 0, "");     // 对端声明支持sack
+    for (uint32_t sn = 0; sn < 127; ++sn) {
+        input(kcp, CMD_PUSH, 0, sn, 0, "x");
+    }
+    input(kcp, CMD_PUSH, 0, 128, 0, "x");
+    input(kcp, CMD_PUSH, 0, 127, 0, "x");
+
+    gOutput.clear();
+    ikcp_update(kcp, 10);
+
+    uint32_t una = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    bool found = findSack(una, ranges);
+    bool ok = found && una == 128 && ranges.size() == 1 && ranges[0].first == 128 && ranges[0].second == 129;
+    printf("%-32s una %u, ranges", "full rcv_queue", una);
+    for (auto &range : ranges) {
+        printf(" [%u, %u)", range.first, range.second);
+    }
+    printf(" %s\n", ok ? "ok" : "FAILED");
+    ikcp_release(kcp);
+    return ok;
+}
+
+static bool testRepeatedHole()
+{
+    ikcpcb *kcp = ikcp_create(0x1024, nullptr);
+    ikcp_setoutput(kcp, output);
+    ikcp_nodelay(kcp, 1, 10, 2, 1);
+    for (int i = 0; i < 5; ++i) {
+        ikcp_send(kcp, "x", 1);
+    }
+    ikcp_update(kcp, 0);
+
+    for (uint32_t sn = 1; sn < 5; ++sn) {
+        std::string ranges;
+        encode32u(ranges, sn);
+        encode32u(ranges, sn + 1);
+        input(kcp, CMD_SACK, 0, sn, 0, ranges);
+    }
+
+    bool ok = kcp->nsnd_buf == 1 && kcp->nfastlist == 1;
+    printf("%-32s nsnd_buf %u, nfastlist %u %s\n", "repeated hole", kcp->nsnd_buf, kcp->nfastlist,
+        ok ? "ok" : "FAILED");
+    ikcp_release(kcp);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    bool ok = testFullQueue();
+    ok = testRepeatedHole() && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+/*************************************************************************
+    > File Name: kcp_writable_test.cc
+    > Author: hsz
+    > Brief:
+    > Created Time: Wed 21 Oct 2026 11:08:36 AM CST
+ ************************************************************************/
+
+// 发送水位回归: 回环上两个会话, 生产者线程不断发送直到WOULD_BLOCK, 随后等待可写回调.
+// 每轮结束后停顿不同时长使会话确认完毕进入空闲, 生产者在空闲会话上读到过时水位时也必须收到可写回调,
+// 任一轮等待超时即失败
+
+#include "../kcpmanager.h"
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <log/log.h>
+
+#define LOG_TAG     "kcp-writable"
+#define PORT_A      12200
+#define PORT_B      12201
+#define HIGH_WATER  32
+#define ROUNDS      500
+#define TIMEOUT_MS  3000
+
+static std::mutex               gMutex;
+static std::condition_variable  gCond;
+static bool                     gWritable = false;
+
+static int createSocket(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("create socket fail!");
+        return -1;
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("socket bind fail!");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static Kcp::SP createKcp(int fd, uint16_t peerPort)
+{
+    KcpAttr attr;
+    attr.fd = fd;
+    attr.autoClose = true;
+    attr.conv = 0x2048;
+    attr.interval = 10;
+    attr.nodelay = 1;
+    attr.fastResend = 2;
+    attr.sendHighWater = HIGH_WATER;
+    attr.addr.sin_family = AF_INET;
+    attr.addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    attr.addr.sin_port = htons(peerPort);
+    return Kcp::SP(new Kcp(attr));
+}
+
+static void onWritableEvent()
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    gWritable = true;
+    gCond.notify_one();
+}
+
+int main(int argc, char **argv)
+{
+    eular::log::InitLog(LogLevel::LEVEL_WARN);
+
+    KcpManager *manager = KcpManagerInstance::Get(2, false, "kcp_writable_test");
+
+    int fdA = createSocket(PORT_A);
+    int fdB = createSocket(PORT_B);
+    assert(fdA > 0 && fdB > 0);
+
+    Kcp::SP sender = createKcp(fdA, PORT_B);
+    Kcp::SP receiver = createKcp(fdB, PORT_A);
+    sender->installWritableEvent(onWritableEvent);
+    receiver->installRecvEvent([] (ByteBuffer &buffer, sockaddr_in addr) {});
+
+    manager->addKcp(sender);
+    manager->addKcp(receiver);
+
+    static char buf[1000] = {0};
+    for (uint32_t round = 0; round < ROUNDS; ++round) {
+        {
+            std::lock_guard<std::mutex> lock(gMutex);
+            gWritable = false;
+        }
+        KcpSendResult ret;
+        do {
+            ret = sender->send(ByteBuffer(buf, sizeof(buf)));
+        } while (ret == KcpSendResult::OK);
+        if (ret != KcpSendResult::WOULD_BLOCK) {
+            printf("round %u: send failed %d\n", round, (int)ret);
+            return 1;
+        }
+
+        std::unique_lock<std::mutex> lock(gMutex);
+        if (!gCond.wait_for(lock, std::chrono::milliseconds(TIMEOUT_MS), [] { return gWritable; })) {
+            printf("round %u: no writable event within %d ms, FAILED\n", round, TIMEOUT_MS);
+            return 1;
+        }
+        lock.unlock();
+        usleep((round % 8) * 5000);     // 0~35ms, 部分轮次中会话已空闲
+    }
+
+    printf("%d rounds at high water %d, writable event every round, ok\n", ROUNDS, HIGH_WATER);
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*************************************************************************
+    > File Name: kqueue_benchmark.cc
+    > Author: hsz
+    > Brief:
+    > Created Time: Sat 17 Oct 2026 10:06:33 PM CST
+ ************************************************************************/
+
+// 发送队列吞吐对比: KMpscQueue与原先的 eular::Mutex + std::list, 生产者数 1/4/16, 单消费者
+
+#include "../kqueue.h"
+#include <utils/mutex.h>
+#include <stdio.h>
+#include <sched.h>
+#include <list>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#define TOTAL_MESSAGES  (4 * 1000 * 1000)
+#define QUEUE_CAPACITY  1024
+
+struct Message {
+    uint64_t producer = 0;
+    uint64_t seq = 0;
+};
+
+static double benchRing(uint32_t producers, uint64_t &fullCount)
+{
+    KMpscQueue<Message> queue(QUEUE_CAPACITY);
+    std::atomic<uint64_t> full(0);
+    uint64_t perProducer = TOTAL_MESSAGES / producers;
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (uint32_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] () {
+            uint64_t localFull = 0;
+            for (uint64_t i = 0; i < perProducer; ++i) {
+                while (!queue.push([&] (Message &msg) { msg.producer = p; msg.seq = i; })) {
+                    ++localFull;
+                    sched_yield();
+                }
+            }
+            full += localFull;
+        });
+    }
+
+    Message msg;
+    uint64_t received = 0;
+    while (received < perProducer * producers) {
+        if (queue.pop(msg)) {
+            ++received;
+        } else {
+            sched_yield();
+        }
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    fullCount = full;
+    double sec = std::chrono::duration<double>(end - begin).count();
+    return received / sec;
+}
+
+static double benchMutexList(uint32_t producers)
+{
+    eular::Mutex mutex;
+    std::list<Message> queue;
+    uint64_t perProducer = TOTAL_MESSAGES / producers;
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (uint32_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] () {
+            for (uint64_t i = 0; i < perProducer; ++i) {
+                Message msg;
+                msg.producer = p;
+                msg.seq = i;
+                eular::AutoLock<eular::Mutex> lock(mutex);
+                queue.push_back(msg);
+            }
+        });
+    }
+
+    // 与原outputRoutine相同, 加锁后整体取走
+    uint64_t received = 0;
+    while (received < perProducer * producers) {
+        std::list<Message> batch;
+        {
+            eular::AutoLock<eular::Mutex> lock(mutex);
+            batch = std::move(queue);
+            queue.clear();
+        }
+        if (batch.empty()) {
+            sched_yield();
+        }
+        received += batch.size();
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double sec = std::chrono::duration<double>(end - begin).count();
+    return received / sec;
+}
+
+int main(int argc, char **argv)
+{
+    const uint32_t producerCounts[] = {1, 4, 16};
+
+    printf("%-10s %-16s %-16s %-12s\n", "producers", "mpsc(Mops/s)", "mutex(Mops/s)", "ring full");
+    for (uint32_t producers : producerCounts) {
+        uint64_t fullCount = 0;
+        double ring = benchRing(producers, fullCount);
+        double mutex = benchMutexList(producers);
+        printf("%-10u %-16.2f %-16.2f %-12lu\n", producers, ring / 1e6, mutex / 1e6, (unsigned long)fullCount);
+    }
+
+    return 0;
+}
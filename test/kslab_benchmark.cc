@@ -0,0 +1,114 @@
+/*************************************************************************
+    > File Name: kslab_benchmark.cc
+    > Author: hsz
+    > Brief:
+    > Created Time: Mon 19 Oct 2026 10:02:48 AM CST
+ ************************************************************************/
+
+// 段分配对比: KSlabAllocator与malloc/free, 单线程保持窗口内的块滚动分配释放,
+// 以及一个线程分配、另一个线程释放(发送线程组包, 所属线程确认后释放). 最后打印池占用与空闲回收
+
+#include "../kslab.h"
+#include "../kqueue.h"
+#include "../ikcp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#define TOTAL_BLOCKS    (8 * 1000 * 1000)
+#define WINDOW          1024
+#define BLOCK_SIZE      (sizeof(IKCPSEG) + 1376)
+
+typedef void *(*MallocFn)(size_t);
+typedef void (*FreeFn)(void *);
+
+static double benchWindow(MallocFn allocFn, FreeFn freeFn)
+{
+    std::vector<void *> window(WINDOW, nullptr);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < TOTAL_BLOCKS; ++i) {
+        void *&slot = window[i % WINDOW];
+        freeFn(slot);
+        slot = allocFn(BLOCK_SIZE);
+        *static_cast<char *>(slot) = 0;
+    }
+    for (void *ptr : window) {
+        freeFn(ptr);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double sec = std::chrono::duration<double>(end - begin).count();
+    return TOTAL_BLOCKS / sec;
+}
+
+static double benchCrossThread(MallocFn allocFn, FreeFn freeFn)
+{
+    KMpscQueue<void *> queue(WINDOW);
+
+    auto begin = std::chrono::steady_clock::now();
+    std::thread producer([&] () {
+        for (uint64_t i = 0; i < TOTAL_BLOCKS; ++i) {
+            void *ptr = allocFn(BLOCK_SIZE);
+            *static_cast<char *>(ptr) = 0;
+            while (!queue.push([ptr] (void *&slot) { slot = ptr; })) {
+                sched_yield();
+            }
+        }
+    });
+
+    void *ptr = nullptr;
+    uint64_t released = 0;
+    while (released < TOTAL_BLOCKS) {
+        if (queue.pop(ptr)) {
+            freeFn(ptr);
+            ++released;
+        } else {
+            sched_yield();
+        }
+    }
+    producer.join();
+    auto end = std::chrono::steady_clock::now();
+
+    double sec = std::chrono::duration<double>(end - begin).count();
+    return TOTAL_BLOCKS / sec;
+}
+
+static void printStats(const char *when)
+{
+    KSlabStats stats = KSlabAllocator::GetStats();
+    printf("%-24s slabs %lu, blocks %lu/%lu, remote frees %lu, released slabs %lu, fallbacks %lu\n", when,
+        (unsigned long)stats.slabs, (unsigned long)stats.usedBlocks, (unsigned long)stats.blocks,
+        (unsigned long)stats.remoteFrees, (unsigned long)stats.releasedSlabs, (unsigned long)stats.fallbacks);
+}
+
+int main(int argc, char **argv)
+{
+    KSlabConfig config;
+    config.idleBlocks = 4096;
+    KSlabAllocator::Install(config);
+
+    printf("%-16s %-16s %-16s\n", "pattern", "slab(Mops/s)", "malloc(Mops/s)");
+    double slab = benchWindow(&KSlabAllocator::Malloc, &KSlabAllocator::Free);
+    double heap = benchWindow(&malloc, &free);
+    printf("%-16s %-16.2f %-16.2f\n", "same thread", slab / 1e6, heap / 1e6);
+    slab = benchCrossThread(&KSlabAllocator::Malloc, &KSlabAllocator::Free);
+    heap = benchCrossThread(&malloc, &free);
+    printf("%-16s %-16.2f %-16.2f\n", "cross thread", slab / 1e6, heap / 1e6);
+    printStats("after benchmark");
+
+    // 突发占用后全部释放, 超出idleBlocks的空slab归还系统
+    std::vector<void *> burst(64 * 1024);
+    for (void *&ptr : burst) {
+        ptr = KSlabAllocator::Malloc(BLOCK_SIZE);
+    }
+    printStats("burst of 65536 blocks");
+    for (void *ptr : burst) {
+        KSlabAllocator::Free(ptr);
+    }
+    printStats("burst released");
+    return 0;
+}
@@ -0,0 +1,103 @@
+/*************************************************************************
+    > File Name: test_kcp_listener.cc
+    > Author: hsz
+    > Brief:
+    > Created Time: Sat 17 Oct 2026 05:40:21 PM CST
+ ************************************************************************/
+
+// 与test_kcp_client配对: 先启动kcp_listener, 再启动kcp_client, 客户端会话号0x1024落在convBase起的范围内即被接受
+
+#include "../kcpmanager.h"
+#include <assert.h>
+#include <iostream>
+#include <signal.h>
+#include <log/log.h>
+#include <log/callstack.h>
+
+#define LOG_TAG "test-kcp-listener"
+
+using namespace std;
+
+#define SERVER_PORT 12000
+
+int createSocket()
+{
+    int server_fd, ret;
+    sockaddr_in addr;
+    socklen_t len = sizeof(sockaddr_in);
+
+    server_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (server_fd < 0) {
+        perror("create socket fail!");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(SERVER_PORT);
+
+    ret = bind(server_fd, (struct sockaddr*)&addr, len);
+    if (ret < 0) {
+        perror("socket bind fail!");
+        return -1;
+    }
+
+    return server_fd;
+}
+
+void onReadEvent(Kcp *kcp, ByteBuffer &buffer, sockaddr_in addr)
+{
+    LOGI("%s() (%zu) [%s:%d]", __func__, buffer.size(), inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+    uint8_t buf[128] = {0};
+    sprintf((char *)buf, "RECV %zuBytes", buffer.size());
+    kcp->send(ByteBuffer(buf, strlen((char *)buf)));
+}
+
+void onAcceptEvent(Kcp::SP kcp)
+{
+    kcp->installRecvEvent(std::bind(onReadEvent, kcp.get(), std::placeholders::_1, std::placeholders::_2));
+}
+
+void onCloseEvent(Kcp::SP kcp)
+{
+    LOGI("%s() session closed", __func__);
+}
+
+void signalCatch(int sig)
+{
+    CallStack stack;
+    stack.update();
+    stack.log(LOG_TAG, eular::LogLevel::LEVEL_FATAL);
+
+    exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    signal(SIGSEGV, signalCatch);
+    signal(SIGABRT, signalCatch);
+
+    KcpManager *manager = KcpManagerInstance::Get(1, true, "test_kcp_listener");
+
+    int udp = createSocket();
+    assert(udp > 0);
+
+    KcpListenerAttr attr;
+    attr.fd = udp;
+    attr.autoClose = true;
+    attr.convBase = 0x1024;     // 与test_kcp_client的conv一致
+    attr.maxSessions = 1024;
+    attr.session.interval = 20;
+    attr.session.nodelay = 1;
+    attr.session.fastResend = 2;
+
+    KcpListener::SP listener(new KcpListener(attr));
+    listener->installAcceptEvent(onAcceptEvent);
+    listener->installCloseEvent(onCloseEvent);
+
+    manager->addListener(listener);
+    KcpManager::GetMainFiber()->resume();
+
+    return 0;
+}